@@ -771,6 +771,17 @@ static void _abyss_wipe_unmasked_area(const map_bitmask &abyss_preserve_mask)
             _abyss_wipe_square_at(*ri);
 }
 
+// Torches the squares that were moved away from and not moved onto. The
+// rest of the area outside the preserve mask is already wiped, and wiping
+// a square is not cheap, so don't redo the whole level.
+static void _abyss_wipe_vacated_area(const map_bitmask &shifted_area,
+                                     const map_bitmask &abyss_preserve_mask)
+{
+    for (rectangle_iterator ri(MAPGEN_BORDER); ri; ++ri)
+        if (shifted_area(*ri) && !abyss_preserve_mask(*ri))
+            _abyss_wipe_square_at(*ri);
+}
+
 // Moves everything at src to dst.
 static void _abyss_move_entities_at(coord_def src, coord_def dst)
 {
@@ -990,6 +1001,7 @@ static void _abyss_shift_level_contents_around_player(
     // Zap everything except the area we're shifting, so that there's
     // nothing in the way of moving stuff.
     _abyss_wipe_unmasked_area(abyss_destruction_mask);
+    const map_bitmask shifted_area = abyss_destruction_mask;
 
     // Move stuff to its new home. This will also move the player.
     _abyss_move_entities(target_centre, &abyss_destruction_mask);
@@ -998,8 +1010,8 @@ static void _abyss_shift_level_contents_around_player(
     // code did not do this, leaving a repeated swatch of Abyss behind
     // at the old location for every shift; discussions between Linley
     // and dpeg on IRC confirm that this (repeated swatch of terrain left
-    // behind) was not intentional.
-    _abyss_wipe_unmasked_area(abyss_destruction_mask);
+    // behind) was not intentional. Only the old location can need it.
+    _abyss_wipe_vacated_area(shifted_area, abyss_destruction_mask);
 
     // So far we've used the mask to track the portions of the level we're
     // preserving. The inverse of the mask represents the area to be filled
@@ -1134,6 +1146,33 @@ const static RiverLayout rivers(1800, baseLayout);
 // This one is not fixed: [0] is a level pulled from the current game
 static vector<const ProceduralLayout*> complex_vec(2);
 
+// When the whole visible area is regenerated, the abyss layout is sampled a
+// row at a time (which lets the noise layouts share work between adjacent
+// cells) and the samples are kept here until their cells are updated.
+static bool abyss_sample_rows_active = false;
+static vector<ProceduralSample> abyss_sample_rows[GYM];
+
+static void _clear_abyss_sample_rows()
+{
+    abyss_sample_rows_active = false;
+    for (vector<ProceduralSample> &row : abyss_sample_rows)
+        row.clear();
+}
+
+static ProceduralSample _abyss_layout_sample(const coord_def &p)
+{
+    if (!abyss_sample_rows_active)
+        return (*abyssLayout)(p + abyssal_state.major_coord, abyssal_state.depth);
+
+    vector<ProceduralSample> &row = abyss_sample_rows[p.y];
+    if (row.empty())
+    {
+        abyssLayout->sample_row(coord_def(0, p.y) + abyssal_state.major_coord,
+                                GXM, abyssal_state.depth, row);
+    }
+    return row[p.x];
+}
+
 static ProceduralSample _abyss_grid(const coord_def &p)
 {
     const coord_def pt = p + abyssal_state.major_coord;
@@ -1159,7 +1198,7 @@ static ProceduralSample _abyss_grid(const coord_def &p)
         }
     }
 
-    const ProceduralSample sample = (*abyssLayout)(pt, abyssal_state.depth);
+    const ProceduralSample sample = _abyss_layout_sample(p);
     ASSERT(sample.feat() > DNGN_UNSEEN);
 
     abyss_sample_queue.push(sample);
@@ -1344,6 +1383,7 @@ static void _abyss_apply_terrain(const map_bitmask &abyss_genlevel_mask,
 
     int ii = 0;
     int delta = you.time_taken * (you.abyss_speed + 40) / 200;
+    abyss_sample_rows_active = !used_queue;
     for (rectangle_iterator ri(MAPGEN_BORDER); ri; ++ri)
     {
         const coord_def p(*ri);
@@ -1381,6 +1421,7 @@ static void _abyss_apply_terrain(const map_bitmask &abyss_genlevel_mask,
                                    DNGN_ABYSSAL_STAIR,
                                    abyss_genlevel_mask);
     }
+    _clear_abyss_sample_rows();
     if (ii)
         dprf(DIAG_ABYSS, "Nuked %d features", ii);
     _ensure_player_habitable(false);
@@ -0,0 +1,72 @@
+#include "catch.hpp"
+
+#include "AppHdr.h"
+
+#include "dgn-proclayouts.h"
+#include "worley.h"
+
+TEST_CASE("worley::noise_row matches worley::noise", "[single-file]")
+{
+    const auto y = GENERATE(-7.25, 0.0, 3.5, 1234.5);
+    const auto z = GENERATE(-2.0, 0.0, 0.125, 9876.5);
+    const auto step = GENERATE(0.3, 1.0, 2.5);
+    CAPTURE(y, z, step);
+
+    const int count = 80;
+    vector<double> xs(count);
+    for (int i = 0; i < count; ++i)
+        xs[i] = -40.0 + i * step;
+
+    vector<worley::noise_datum> row(count);
+    worley::noise_row(xs.data(), count, y, z, row.data());
+
+    for (int i = 0; i < count; ++i)
+    {
+        CAPTURE(xs[i]);
+        const worley::noise_datum n = worley::noise(xs[i], y, z);
+        for (int j = 0; j < 2; ++j)
+        {
+            REQUIRE(row[i].distance[j] == n.distance[j]);
+            REQUIRE(row[i].id[j] == n.id[j]);
+            for (int k = 0; k < 3; ++k)
+                REQUIRE(row[i].pos[j][k] == n.pos[j][k]);
+        }
+    }
+}
+
+TEST_CASE("ProceduralLayout::sample_row matches single samples",
+          "[single-file]")
+{
+    const WastesLayout wastes;
+    const RoilingChaosLayout chaos(8675309, 450);
+    const NewAbyssLayout new_abyss(7629);
+    const vector<const ProceduralLayout*> sublayouts = { &chaos, &new_abyss };
+    const WorleyLayout worley_layout(4321, sublayouts);
+    const RiverLayout rivers(1800, worley_layout);
+    const ProceduralLayout* layouts[] =
+    {
+        &wastes, &chaos, &new_abyss, &worley_layout, &rivers,
+    };
+
+    const auto y = GENERATE(-500, 0, 31, 700001);
+    const auto offset = GENERATE(0u, 977u, 123456u);
+    CAPTURE(y, offset);
+
+    for (const ProceduralLayout *layout : layouts)
+    {
+        const coord_def start(-1000, y);
+        vector<ProceduralSample> row;
+        layout->sample_row(start, GXM, offset, row);
+        REQUIRE(row.size() == (size_t) GXM);
+
+        for (int i = 0; i < GXM; ++i)
+        {
+            const coord_def p = start + coord_def(i, 0);
+            CAPTURE(p.x);
+            const ProceduralSample sample = (*layout)(p, offset);
+            REQUIRE(row[i].coord() == sample.coord());
+            REQUIRE(row[i].feat() == sample.feat());
+            REQUIRE(row[i].changepoint() == sample.changepoint());
+        }
+    }
+}
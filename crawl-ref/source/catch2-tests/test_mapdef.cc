@@ -0,0 +1,53 @@
+#include "catch.hpp"
+
+#include "AppHdr.h"
+
+#include "dlua.h"
+#include "mapdef.h"
+
+TEST_CASE("map_def copies do not share tag changes", "[single-file]")
+{
+    map_def original;
+    original.set_tags("minivault foo");
+
+    map_def copy = original;
+    CHECK(copy.has_tag("foo"));
+    CHECK(copy.is_minivault());
+
+    copy.add_tags("bar");
+    copy.remove_tags("foo");
+    CHECK(copy.has_tag("bar"));
+    CHECK_FALSE(copy.has_tag("foo"));
+    CHECK(original.has_tag("foo"));
+    CHECK_FALSE(original.has_tag("bar"));
+
+    copy.clear_tags();
+    CHECK_FALSE(copy.is_minivault());
+    CHECK(original.is_minivault());
+    CHECK(original.tags_string() == "foo minivault");
+
+    // Re-adding tags that are already there leaves the copy as it was.
+    map_def again = original;
+    again.add_tags("foo");
+    CHECK(again.tags_string() == original.tags_string());
+}
+
+TEST_CASE("dlua_chunk copies do not share source changes", "[single-file]")
+{
+    dlua_chunk original;
+    original.set_file("foo.des");
+    original.add(1, "x = 1");
+    CHECK_FALSE(original.empty());
+
+    dlua_chunk copy = original;
+    CHECK(copy.lua_string() == original.lua_string());
+
+    copy.add(2, "y = 2");
+    CHECK(copy.lua_string() != original.lua_string());
+    CHECK(original.lua_string() == " x = 1");
+
+    copy.clear();
+    CHECK(copy.empty());
+    CHECK(copy.lua_string().empty());
+    CHECK_FALSE(original.empty());
+}
@@ -245,3 +245,64 @@ TEST_CASE( "Basic marshalling/unmarshalling works correctly.", "[single-file]" )
         }
     }
 }
+
+TEST_CASE( "Map knowledge can be roundtripped in columnar form", "[single-file]" ) {
+
+    typedef FixedArray<map_cell, GXM, GYM> map_grid;
+
+    auto same_cell = [](const map_cell &a, const map_cell &b) {
+        return a.flags == b.flags && a.feat() == b.feat()
+               && a.feat_colour() == b.feat_colour()
+               && a.cloud() == b.cloud();
+    };
+
+    unique_ptr<map_grid> map(new map_grid);
+    for (int x = 0; x < GXM; x++)
+        for (int y = 0; y < GYM; y++)
+        {
+            (*map)[x][y].set_feature(x % 7 ? DNGN_FLOOR : DNGN_ROCK_WALL);
+            (*map)[x][y].flags = MAP_SEEN_FLAG | (y > 30 ? MAP_BLOODY : 0);
+        }
+    (*map)[10][10].set_cloud(cloud_info(CLOUD_FIRE, RED, 2, 0,
+                                        coord_def(10, 10), KILL_YOU));
+    (*map)[10][11].set_feature(DNGN_FLOOR, GREEN);
+
+    SECTION ("the current map can be roundtripped.") {
+        vector<unsigned char> buf;
+        auto w = writer(&buf);
+        marshallMapKnowledge(w, *map);
+
+        // Long runs should make this much smaller than a cell per byte.
+        REQUIRE(buf.size() < GXM * GYM / 4);
+
+        auto r = reader(buf, TAG_MINOR_VERSION);
+        unique_ptr<map_grid> roundtrip(new map_grid);
+        unmarshallMapKnowledge(r, *roundtrip);
+
+        for (int x = 0; x < GXM; x++)
+            for (int y = 0; y < GYM; y++)
+                REQUIRE(same_cell((*map)[x][y], (*roundtrip)[x][y]));
+        REQUIRE(r.valid() == false);
+    }
+
+    SECTION ("a forgotten map can be roundtripped as a delta.") {
+        unique_ptr<map_grid> forgotten(new map_grid);
+        *forgotten = *map;
+        (*forgotten)[5][5].clear();
+        (*forgotten)[10][10].clear_cloud();
+
+        vector<unsigned char> buf;
+        auto w = writer(&buf);
+        marshallMapDelta(w, *forgotten, *map);
+
+        auto r = reader(buf, TAG_MINOR_VERSION);
+        unique_ptr<map_grid> roundtrip(new map_grid);
+        *roundtrip = *map;
+        unmarshallMapDelta(r, *roundtrip);
+
+        for (int x = 0; x < GXM; x++)
+            for (int y = 0; y < GYM; y++)
+                REQUIRE(same_cell((*forgotten)[x][y], (*roundtrip)[x][y]));
+        REQUIRE(r.valid() == false);
+    }
+}
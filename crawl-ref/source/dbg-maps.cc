@@ -7,10 +7,17 @@
 
 #include "dbg-maps.h"
 
+#include <cerrno>
+#ifdef UNIX
+#include <sys/wait.h>
+#include <unistd.h>
+#endif
+
 #include "branch.h"
 #include "chardump.h"
 #include "crash.h"
 #include "dbg-objstat.h"
+#include "dbg-util.h"
 #include "dungeon.h"
 #include "env.h"
 #include "initfile.h"
@@ -22,7 +29,9 @@
 #include "shopping.h"
 #include "state.h"
 #include "stringutil.h"
+#include "syscalls.h"
 #include "tag-version.h"
+#include "tags.h"
 #include "view.h"
 
 #ifdef DEBUG_STATISTICS
@@ -47,6 +56,20 @@ static int build_attempts = 0, level_vetoes = 0;
 // Map from message to counts.
 static map<string, int> veto_messages;
 
+struct builder_time
+{
+    int64_t usecs = 0;
+    int calls = 0;
+#ifdef DEBUG_ALLOCATIONS
+    int64_t allocs = 0;
+    int64_t alloc_bytes = 0;
+#endif
+};
+static map<string, builder_time> phase_times;
+static map<string, builder_time> map_times;
+// Map name to number of level vetoes while the map was placed.
+static map<string, int> map_vetoes;
+
 void mapstat_report_map_build_start()
 {
     build_attempts++;
@@ -58,6 +81,38 @@ void mapstat_report_map_veto(const string &message)
     level_vetoes++;
     ++veto_messages[message];
     map_builds[level_id::current()].second++;
+    for (const auto &vault : env.level_vaults)
+        ++map_vetoes[vault->map.name];
+}
+
+mapstat_timer::mapstat_timer(const char *_phase)
+    : name(_phase), is_map(false), start(chrono::steady_clock::now())
+#ifdef DEBUG_ALLOCATIONS
+      , start_allocs(debug_alloc_count()),
+      start_alloc_bytes(debug_alloc_bytes())
+#endif
+{
+}
+
+mapstat_timer::mapstat_timer(const map_def &map)
+    : name(map.name), is_map(true), start(chrono::steady_clock::now())
+#ifdef DEBUG_ALLOCATIONS
+      , start_allocs(debug_alloc_count()),
+      start_alloc_bytes(debug_alloc_bytes())
+#endif
+{
+}
+
+mapstat_timer::~mapstat_timer()
+{
+    builder_time &bt = is_map ? map_times[name] : phase_times[name];
+    bt.usecs += chrono::duration_cast<chrono::microseconds>(
+                    chrono::steady_clock::now() - start).count();
+    bt.calls++;
+#ifdef DEBUG_ALLOCATIONS
+    bt.allocs += debug_alloc_count() - start_allocs;
+    bt.alloc_bytes += debug_alloc_bytes() - start_alloc_bytes;
+#endif
 }
 
 static bool _is_disconnected_level()
@@ -230,26 +285,12 @@ static bool _build_dungeon()
     return true;
 }
 
-/**
- * Build dungeon levels for mapstat or objstat.
- *
- * The exact branches/levels built and number of build iterations is set by the
- * command-line options for mapstat/objstat.
-
- * @returns True if all iterations built successfully. For mapstat, this can
- * return false if an iteration produced a disconnected level, since for
- * diagnostic purposes we record the map in detail to a file and exit. For
- * objstat, this only returns false if the primary dungeon generation function
- * builder() fails, as the level may be in an invalid state and any object
- * statistics erroneous.
-*/
-bool mapstat_build_levels()
+// Build iterations [first, last) of the levels in generated_levels.
+static bool _build_iterations(int first, int last)
 {
-    if (!generated_levels.size())
-        _dungeon_places();
     printf("Iteration: ");
     fflush(stdout);
-    for (int i = 0; i < SysEnv.map_gen_iters; ++i)
+    for (int i = first; i < last; ++i)
     {
         clear_messages();
         mprf("On %d of %d; %d g, %d fail, %u err%s, %u uniq, "
@@ -274,6 +315,290 @@ bool mapstat_build_levels()
         if (crawl_state.obj_stat_gen)
             objstat_iteration_stats();
     }
+    return true;
+}
+
+#ifdef UNIX
+static void _marshall_counts(writer &outf, const map<string, int> &counts)
+{
+    marshallInt(outf, counts.size());
+    for (const auto &entry : counts)
+    {
+        marshallString(outf, entry.first);
+        marshallInt(outf, entry.second);
+    }
+}
+
+static void _merge_counts(reader &inf, map<string, int> &counts)
+{
+    for (int i = 0, size = unmarshallInt(inf); i < size; ++i)
+    {
+        const string name = unmarshallString(inf);
+        counts[name] += unmarshallInt(inf);
+    }
+}
+
+static void _marshall_times(writer &outf,
+                            const map<string, builder_time> &times)
+{
+    marshallInt(outf, times.size());
+    for (const auto &entry : times)
+    {
+        marshallString(outf, entry.first);
+        marshallSigned(outf, entry.second.usecs);
+        marshallInt(outf, entry.second.calls);
+#ifdef DEBUG_ALLOCATIONS
+        marshallSigned(outf, entry.second.allocs);
+        marshallSigned(outf, entry.second.alloc_bytes);
+#endif
+    }
+}
+
+static void _merge_times(reader &inf, map<string, builder_time> &times)
+{
+    for (int i = 0, size = unmarshallInt(inf); i < size; ++i)
+    {
+        builder_time &bt = times[unmarshallString(inf)];
+        bt.usecs += unmarshallSigned(inf);
+        bt.calls += unmarshallInt(inf);
+#ifdef DEBUG_ALLOCATIONS
+        bt.allocs += unmarshallSigned(inf);
+        bt.alloc_bytes += unmarshallSigned(inf);
+#endif
+    }
+}
+
+static void _write_shard(writer &outf)
+{
+    marshallInt(outf, levels_tried);
+    marshallInt(outf, levels_failed);
+    marshallInt(outf, build_attempts);
+    marshallInt(outf, level_vetoes);
+
+    _marshall_counts(outf, try_count);
+    _marshall_counts(outf, use_count);
+    _marshall_counts(outf, success_count);
+    _marshall_counts(outf, veto_messages);
+    _marshall_counts(outf, map_vetoes);
+    _marshall_times(outf, phase_times);
+    _marshall_times(outf, map_times);
+
+    marshallInt(outf, level_mapcounts.size());
+    for (const auto &entry : level_mapcounts)
+    {
+        entry.first.save(outf);
+        marshallInt(outf, entry.second);
+    }
+
+    marshallInt(outf, map_builds.size());
+    for (const auto &entry : map_builds)
+    {
+        entry.first.save(outf);
+        marshallInt(outf, entry.second.first);
+        marshallInt(outf, entry.second.second);
+    }
+
+    marshallInt(outf, level_mapsused.size());
+    for (const auto &entry : level_mapsused)
+    {
+        entry.first.save(outf);
+        marshallInt(outf, entry.second.size());
+        for (const string &name : entry.second)
+            marshallString(outf, name);
+    }
+
+    marshallInt(outf, map_levelsused.size());
+    for (const auto &entry : map_levelsused)
+    {
+        marshallString(outf, entry.first);
+        marshallInt(outf, entry.second.size());
+        for (const level_id &lid : entry.second)
+            lid.save(outf);
+    }
+
+    marshallInt(outf, errors.size());
+    for (const auto &entry : errors)
+    {
+        marshallString(outf, entry.first);
+        marshallString(outf, entry.second);
+    }
+    marshallString(outf, last_error);
+
+    if (crawl_state.obj_stat_gen)
+        objstat_write_shard(outf);
+}
+
+static void _merge_shard(reader &inf)
+{
+    levels_tried += unmarshallInt(inf);
+    levels_failed += unmarshallInt(inf);
+    build_attempts += unmarshallInt(inf);
+    level_vetoes += unmarshallInt(inf);
+
+    _merge_counts(inf, try_count);
+    _merge_counts(inf, use_count);
+    _merge_counts(inf, success_count);
+    _merge_counts(inf, veto_messages);
+    _merge_counts(inf, map_vetoes);
+    _merge_times(inf, phase_times);
+    _merge_times(inf, map_times);
+
+    for (int i = 0, size = unmarshallInt(inf); i < size; ++i)
+    {
+        level_id lid;
+        lid.load(inf);
+        level_mapcounts[lid] += unmarshallInt(inf);
+    }
+
+    for (int i = 0, size = unmarshallInt(inf); i < size; ++i)
+    {
+        level_id lid;
+        lid.load(inf);
+        map_builds[lid].first += unmarshallInt(inf);
+        map_builds[lid].second += unmarshallInt(inf);
+    }
+
+    for (int i = 0, size = unmarshallInt(inf); i < size; ++i)
+    {
+        level_id lid;
+        lid.load(inf);
+        set<string> &names = level_mapsused[lid];
+        for (int j = 0, count = unmarshallInt(inf); j < count; ++j)
+            names.insert(unmarshallString(inf));
+    }
+
+    for (int i = 0, size = unmarshallInt(inf); i < size; ++i)
+    {
+        set<level_id> &levels = map_levelsused[unmarshallString(inf)];
+        for (int j = 0, count = unmarshallInt(inf); j < count; ++j)
+        {
+            level_id lid;
+            lid.load(inf);
+            levels.insert(lid);
+        }
+    }
+
+    for (int i = 0, size = unmarshallInt(inf); i < size; ++i)
+    {
+        const string name = unmarshallString(inf);
+        errors[name] = unmarshallString(inf);
+    }
+    const string shard_error = unmarshallString(inf);
+    if (!shard_error.empty())
+        last_error = shard_error;
+
+    if (crawl_state.obj_stat_gen)
+        objstat_merge_shard(inf);
+}
+
+static string _shard_file(pid_t driver, int shard)
+{
+    return make_stringf("mapstat-shard-%d-%d.tmp", (int) driver, shard);
+}
+
+/**
+ * Split the iterations over `jobs` forked workers, each with its own rng
+ * seed. Workers write their statistics to a shard file when done, and the
+ * driver merges the shards into its own (so far empty) tables, as if it had
+ * built every iteration itself.
+ */
+static bool _build_iterations_sharded(int jobs)
+{
+    jobs = min(jobs, SysEnv.map_gen_iters);
+    const pid_t driver = getpid();
+    const uint64_t base_seed = rng::get_uint64();
+
+    printf("Starting %d workers.\n", jobs);
+    fflush(stdout);
+
+    vector<pid_t> workers;
+    for (int shard = 0; shard < jobs; ++shard)
+    {
+        const int first = SysEnv.map_gen_iters * shard / jobs;
+        const int last = SysEnv.map_gen_iters * (shard + 1) / jobs;
+
+        const pid_t pid = fork();
+        if (pid == -1)
+        {
+            fprintf(stderr, "Couldn't fork: %s\n", strerror(errno));
+            for (pid_t worker : workers)
+                waitpid(worker, nullptr, 0);
+            return false;
+        }
+        if (pid == 0)
+        {
+            rng::seed(base_seed + shard);
+            const bool built = _build_iterations(first, last);
+
+            const string shard_file = _shard_file(driver, shard);
+            FILE *fp = fopen_u(shard_file.c_str(), "wb");
+            if (!fp)
+                _exit(2);
+            {
+                writer outf(shard_file, fp);
+                _write_shard(outf);
+            }
+            fclose(fp);
+            fflush(stdout);
+            _exit(built ? 0 : 1);
+        }
+        workers.push_back(pid);
+    }
+
+    bool ok = true;
+    for (int shard = 0; shard < jobs; ++shard)
+    {
+        int status = 0;
+        waitpid(workers[shard], &status, 0);
+        const int code = WIFEXITED(status) ? WEXITSTATUS(status) : -1;
+        if (code != 0)
+            ok = false;
+        if (code != 0 && code != 1)
+        {
+            fprintf(stderr, "\nWorker %d failed (status %d); its results are "
+                            "lost.\n", shard, status);
+            continue;
+        }
+
+        const string shard_file = _shard_file(driver, shard);
+        {
+            reader inf(shard_file, TAG_MINOR_VERSION);
+            _merge_shard(inf);
+        }
+        unlink_u(shard_file.c_str());
+    }
+    return ok;
+}
+#endif
+
+/**
+ * Build dungeon levels for mapstat or objstat.
+ *
+ * The exact branches/levels built and number of build iterations is set by the
+ * command-line options for mapstat/objstat.
+
+ * @returns True if all iterations built successfully. For mapstat, this can
+ * return false if an iteration produced a disconnected level, since for
+ * diagnostic purposes we record the map in detail to a file and exit. For
+ * objstat, this only returns false if the primary dungeon generation function
+ * builder() fails, as the level may be in an invalid state and any object
+ * statistics erroneous.
+*/
+bool mapstat_build_levels()
+{
+    if (!generated_levels.size())
+        _dungeon_places();
+
+    bool built;
+#ifdef UNIX
+    if (SysEnv.map_gen_jobs > 1)
+        built = _build_iterations_sharded(SysEnv.map_gen_jobs);
+    else
+#endif
+        built = _build_iterations(0, SysEnv.map_gen_iters);
+    if (!built)
+        return false;
+
     printf("Finished.\n");
     fflush(stdout);
     return true;
@@ -417,6 +742,56 @@ static void _write_map_stats()
             fprintf(outf, "%3d) %s\n", i->first, i->second.c_str());
     }
 
+    if (!phase_times.empty())
+    {
+#ifdef DEBUG_ALLOCATIONS
+        fprintf(outf, "\n\nBuilder time by phase (total ms, calls, ms/call, "
+                      "allocs/call, KB allocated/call):\n\n");
+#else
+        fprintf(outf, "\n\nBuilder time by phase (total ms, calls, "
+                      "ms/call):\n\n");
+#endif
+        for (const auto &entry : phase_times)
+        {
+            const builder_time &bt = entry.second;
+            fprintf(outf, "%10.1f, %6d, %8.3f",
+                    bt.usecs / 1000.0, bt.calls,
+                    bt.usecs / 1000.0 / bt.calls);
+#ifdef DEBUG_ALLOCATIONS
+            fprintf(outf, ", %9.1f, %8.1f", (double) bt.allocs / bt.calls,
+                    bt.alloc_bytes / 1024.0 / bt.calls);
+#endif
+            fprintf(outf, ": %s\n", entry.first.c_str());
+        }
+    }
+
+    if (!map_times.empty())
+    {
+#ifdef DEBUG_ALLOCATIONS
+        fprintf(outf, "\n\nMaps by time spent placing them "
+                      "(total ms, tries, ms/try, allocs/try, vetoes):\n\n");
+#else
+        fprintf(outf, "\n\nMaps by time spent placing them "
+                      "(total ms, tries, ms/try, vetoes):\n\n");
+#endif
+        multimap<int64_t, string> sortedtimes;
+        for (const auto &entry : map_times)
+            sortedtimes.insert(make_pair(entry.second.usecs, entry.first));
+
+        for (auto i = sortedtimes.rbegin(); i != sortedtimes.rend(); ++i)
+        {
+            const builder_time &bt = map_times[i->second];
+            fprintf(outf, "%10.1f, %6d, %8.3f",
+                    bt.usecs / 1000.0, bt.calls,
+                    bt.usecs / 1000.0 / bt.calls);
+#ifdef DEBUG_ALLOCATIONS
+            fprintf(outf, ", %9.1f", (double) bt.allocs / bt.calls);
+#endif
+            fprintf(outf, ", %4d: %s\n",
+                    lookup(map_vetoes, i->second, 0), i->second.c_str());
+        }
+    }
+
     if (!unused_maps.empty() && !SysEnv.map_gen_range)
     {
         fprintf(outf, "\n\nUnused maps:\n\n");
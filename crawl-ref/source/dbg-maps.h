@@ -7,6 +7,8 @@
 
 #ifdef DEBUG_STATISTICS
 
+#include <chrono>
+
 class map_def;
 void mapstat_report_map_try(const map_def &map);
 void mapstat_report_map_use(const map_def &map);
@@ -17,4 +19,26 @@ void mapstat_report_map_veto(const string &message);
 void mapstat_generate_stats();
 bool mapstat_build_levels();
 bool mapstat_find_forced_map();
+
+// Charges the time and heap allocations until it goes out of scope to a
+// builder phase, or to the tries of a single map, for the timing tables in
+// mapstat.log.
+class mapstat_timer
+{
+public:
+    explicit mapstat_timer(const char *_phase);
+    explicit mapstat_timer(const map_def &map);
+    ~mapstat_timer();
+
+    void set_phase(const char *_phase) { name = _phase; }
+
+private:
+    string name;
+    bool is_map;
+    chrono::steady_clock::time_point start;
+#ifdef DEBUG_ALLOCATIONS
+    uint64_t start_allocs;
+    uint64_t start_alloc_bytes;
+#endif
+};
 #endif
@@ -9,6 +9,7 @@
 
 #include <cerrno>
 #include <cmath>
+#include <cstring>
 #include <sstream>
 
 #include "artefact.h"
@@ -36,6 +37,7 @@
 #include "stepdown.h"
 #include "stringutil.h"
 #include "tag-version.h"
+#include "tags.h"
 #include "version.h"
 
 #ifdef DEBUG_STATISTICS
@@ -879,6 +881,164 @@ void objstat_iteration_stats()
     }
 }
 
+// Shards from -jobs workers. Every worker starts from the same _init_stats()
+// tables, so records are merged into the matching entry: counts and sums add
+// up, and the per-iteration minimum and maximum fields combine.
+
+static void _marshall_shard_value(writer &outf, double value)
+{
+    uint64_t bits;
+    memcpy(&bits, &value, sizeof(bits));
+    marshallUnsigned(outf, bits);
+}
+
+static void _marshall_shard_value(writer &outf, int value)
+{
+    marshallInt(outf, value);
+}
+
+static void _marshall_shard_key(writer &outf, const level_id &lev)
+{
+    lev.save(outf);
+}
+
+static void _marshall_shard_key(writer &outf, int key)
+{
+    marshallInt(outf, key);
+}
+
+static void _marshall_shard_key(writer &outf, dungeon_feature_type feat)
+{
+    marshallInt(outf, feat);
+}
+
+static void _unmarshall_shard_key(reader &inf, level_id &lev)
+{
+    lev.load(inf);
+}
+
+static void _unmarshall_shard_key(reader &inf, int &key)
+{
+    key = unmarshallInt(inf);
+}
+
+static void _unmarshall_shard_key(reader &inf, dungeon_feature_type &feat)
+{
+    feat = static_cast<dungeon_feature_type>(unmarshallInt(inf));
+}
+
+static void _marshall_shard_value(writer &outf,
+                                  const map<string, double> &stats);
+template <typename T>
+static void _marshall_shard_value(writer &outf, const vector<T> &recs);
+template <typename K, typename T>
+static void _marshall_shard_value(writer &outf, const map<K, T> &recs);
+
+static void _merge_shard_value(reader &inf, int &value);
+static void _merge_shard_value(reader &inf, map<string, double> &stats);
+template <typename T>
+static void _merge_shard_value(reader &inf, vector<T> &recs);
+template <typename K, typename T>
+static void _merge_shard_value(reader &inf, map<K, T> &recs);
+
+static void _marshall_shard_value(writer &outf,
+                                  const map<string, double> &stats)
+{
+    marshallInt(outf, stats.size());
+    for (const auto &entry : stats)
+    {
+        marshallString(outf, entry.first);
+        _marshall_shard_value(outf, entry.second);
+    }
+}
+
+template <typename T>
+static void _marshall_shard_value(writer &outf, const vector<T> &recs)
+{
+    marshallInt(outf, recs.size());
+    for (const T &rec : recs)
+        _marshall_shard_value(outf, rec);
+}
+
+template <typename K, typename T>
+static void _marshall_shard_value(writer &outf, const map<K, T> &recs)
+{
+    marshallInt(outf, recs.size());
+    for (const auto &entry : recs)
+    {
+        _marshall_shard_key(outf, entry.first);
+        _marshall_shard_value(outf, entry.second);
+    }
+}
+
+static void _merge_shard_value(reader &inf, int &value)
+{
+    value += unmarshallInt(inf);
+}
+
+static void _merge_shard_value(reader &inf, map<string, double> &stats)
+{
+    const int count = unmarshallInt(inf);
+    for (int i = 0; i < count; ++i)
+    {
+        const string field = unmarshallString(inf);
+        uint64_t bits = unmarshallUnsigned(inf);
+        double value;
+        memcpy(&value, &bits, sizeof(value));
+
+        auto it = stats.find(field);
+        if (it == stats.end())
+            stats[field] = value;
+        else if (ends_with(field, "Min"))
+            it->second = min(it->second, value);
+        else if (ends_with(field, "Max"))
+            it->second = max(it->second, value);
+        else
+            it->second += value;
+    }
+}
+
+template <typename T>
+static void _merge_shard_value(reader &inf, vector<T> &recs)
+{
+    const int count = unmarshallInt(inf);
+    ASSERT(count == (int) recs.size());
+    for (T &rec : recs)
+        _merge_shard_value(inf, rec);
+}
+
+template <typename K, typename T>
+static void _merge_shard_value(reader &inf, map<K, T> &recs)
+{
+    const int count = unmarshallInt(inf);
+    for (int i = 0; i < count; ++i)
+    {
+        K key;
+        _unmarshall_shard_key(inf, key);
+        _merge_shard_value(inf, recs[key]);
+    }
+}
+
+void objstat_write_shard(writer &outf)
+{
+    _marshall_shard_value(outf, item_recs);
+    _marshall_shard_value(outf, weapon_brands);
+    _marshall_shard_value(outf, armour_brands);
+    _marshall_shard_value(outf, missile_brands);
+    _marshall_shard_value(outf, monster_recs);
+    _marshall_shard_value(outf, feature_recs);
+}
+
+void objstat_merge_shard(reader &inf)
+{
+    _merge_shard_value(inf, item_recs);
+    _merge_shard_value(inf, weapon_brands);
+    _merge_shard_value(inf, armour_brands);
+    _merge_shard_value(inf, missile_brands);
+    _merge_shard_value(inf, monster_recs);
+    _merge_shard_value(inf, feature_recs);
+}
+
 static void _write_stat_headers(const vector<string> &fields, string desc)
 {
     fprintf(stat_outf, "%s\tLevel", desc.c_str());
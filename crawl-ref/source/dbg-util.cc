@@ -7,6 +7,12 @@
 
 #include "dbg-util.h"
 
+#ifdef DEBUG_ALLOCATIONS
+#include <atomic>
+#include <cstdlib>
+#include <new>
+#endif
+
 #include "artefact.h"
 #include "directn.h"
 #include "dungeon.h"
@@ -594,3 +600,34 @@ void wizard_toggle_dprf()
     }
 }
 #endif
+
+#ifdef DEBUG_ALLOCATIONS
+// Count every heap allocation made through operator new, so that profiling
+// modes (-save-bench, -mapstat) can report allocation volume.
+static atomic<uint64_t> _alloc_count(0);
+static atomic<uint64_t> _alloc_bytes(0);
+
+uint64_t debug_alloc_count()
+{
+    return _alloc_count.load(memory_order_relaxed);
+}
+
+uint64_t debug_alloc_bytes()
+{
+    return _alloc_bytes.load(memory_order_relaxed);
+}
+
+void *operator new(size_t size)
+{
+    _alloc_count.fetch_add(1, memory_order_relaxed);
+    _alloc_bytes.fetch_add(size, memory_order_relaxed);
+    if (void *p = malloc(size ? size : 1))
+        return p;
+    throw std::bad_alloc();
+}
+
+void operator delete(void *p) noexcept
+{
+    free(p);
+}
+#endif
@@ -39,3 +39,8 @@ void wizard_toggle_dprf();
 void debug_list_vacant_keys();
 
 vector<string> level_vault_names(bool force_all=false);
+
+#ifdef DEBUG_ALLOCATIONS
+uint64_t debug_alloc_count();
+uint64_t debug_alloc_bytes();
+#endif
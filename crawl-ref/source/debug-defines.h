@@ -51,6 +51,11 @@
     #define DEBUG_STATISTICS
 #endif
 
+// DEBUG_ALLOCATIONS (e.g. make EXTRA_FLAGS=-DDEBUG_ALLOCATIONS) replaces the
+// global operator new with one that counts heap allocations, for the
+// allocation columns of -save-bench and -mapstat. No other define turns it
+// on.
+
 #ifdef DEBUG_MONSPEAK
     // ensure dprf is available
     #define DEBUG_DIAGNOSTICS
@@ -5124,7 +5124,7 @@ int describe_monsters(const monster_info &mi, const string& /*footer*/)
                 needle.to_colour_string(), "SPELLSET_PLACEHOLDER");
     }
     tiles.json_write_string("body", desc_without_spells);
-    tiles.json_write_string("quote", quote);
+    tiles.json_write_string("quote", quote.tostring());
     write_spellset(spells, nullptr, &mi);
 
     {
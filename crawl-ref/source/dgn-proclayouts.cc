@@ -61,11 +61,60 @@ DiamondLayout::operator()(const coord_def &p, const uint32_t offset) const
     return ProceduralSample(p, DNGN_FLOOR, offset + 4096);
 }
 
+void ProceduralLayout::sample_row(const coord_def &start, int width,
+                                  const uint32_t offset,
+                                  vector<ProceduralSample> &out) const
+{
+    for (int i = 0; i < width; ++i)
+        out.push_back((*this)(start + coord_def(i, 0), offset));
+}
+
+// Fill in a row in which the cells with a feature of their own have it in
+// feats, and the rest (DNGN_UNSEEN) come from the fallback layout. Each run
+// of fallback cells is passed on as a single row.
+static void _sample_row_with_fallback(const coord_def &start,
+                                      const vector<dungeon_feature_type> &feats,
+                                      const vector<uint32_t> &changepoints,
+                                      const ProceduralLayout &fallback,
+                                      const uint32_t offset,
+                                      vector<ProceduralSample> &out)
+{
+    const int width = feats.size();
+    for (int i = 0; i < width;)
+    {
+        if (feats[i] != DNGN_UNSEEN)
+        {
+            out.emplace_back(start + coord_def(i, 0), feats[i],
+                             changepoints[i]);
+            ++i;
+            continue;
+        }
+
+        int end = i + 1;
+        while (end < width && feats[end] == DNGN_UNSEEN)
+            ++end;
+        fallback.sample_row(start + coord_def(i, 0), end - i, offset, out);
+        i = end;
+    }
+}
+
 static uint32_t _get_changepoint(const worley::noise_datum &n, const double scale)
 {
     return max(1, (int) floor((n.distance[1] - n.distance[0]) * scale) - 5);
 }
 
+// Which of size sublayouts a WorleyLayout cell uses; id is set to the
+// amount its coordinates are shifted by.
+static uint8_t _worley_layout_choice(const worley::noise_datum &n,
+                                     const uint8_t size, uint32_t &id)
+{
+    bool parity = n.id[0] % 4;
+    id = n.id[0] / 4;
+    return parity
+        ? id % size
+        : min(id % size, (id / size) % size);
+}
+
 ProceduralSample
 WorleyLayout::operator()(const coord_def &p, const uint32_t offset) const
 {
@@ -77,11 +126,8 @@ WorleyLayout::operator()(const coord_def &p, const uint32_t offset) const
 
     const uint32_t changepoint = offset + _get_changepoint(n, offset_scale);
     const uint8_t size = layouts.size();
-    bool parity = n.id[0] % 4;
-    uint32_t id = n.id[0] / 4;
-    const uint8_t choice = parity
-        ? id % size
-        : min(id % size, (id / size) % size);
+    uint32_t id;
+    const uint8_t choice = _worley_layout_choice(n, size, id);
     const coord_def pd = p + id;
     ProceduralSample sample = (*layouts[(choice + seed) % size])(pd, offset);
 
@@ -89,6 +135,52 @@ WorleyLayout::operator()(const coord_def &p, const uint32_t offset) const
                 min(changepoint, sample.changepoint()));
 }
 
+void WorleyLayout::sample_row(const coord_def &start, int width,
+                              const uint32_t offset,
+                              vector<ProceduralSample> &out) const
+{
+    const double offset_scale = 5000.0;
+    vector<double> xs(width);
+    for (int i = 0; i < width; ++i)
+        xs[i] = (start.x + i) / scale;
+    double y = start.y / scale;
+    double z = offset / offset_scale;
+    vector<worley::noise_datum> noise(width);
+    worley::noise_row(xs.data(), width, y, z + seed, noise.data());
+
+    // Neighbouring cells mostly fall in the same worley cell, and so share
+    // a sublayout and shift: sample each such run as one row.
+    const uint8_t size = layouts.size();
+    vector<ProceduralSample> sub;
+    for (int i = 0; i < width;)
+    {
+        uint32_t id;
+        const uint8_t choice = _worley_layout_choice(noise[i], size, id);
+        int end = i + 1;
+        for (; end < width; ++end)
+        {
+            uint32_t next_id;
+            if (_worley_layout_choice(noise[end], size, next_id) != choice
+                || next_id != id)
+            {
+                break;
+            }
+        }
+
+        sub.clear();
+        const coord_def pd = start + coord_def(i, 0) + id;
+        layouts[(choice + seed) % size]->sample_row(pd, end - i, offset, sub);
+        for (int j = i; j < end; ++j)
+        {
+            const uint32_t changepoint = offset
+                + _get_changepoint(noise[j], offset_scale);
+            out.emplace_back(start + coord_def(j, 0), sub[j - i].feat(),
+                             min(changepoint, sub[j - i].changepoint()));
+        }
+        i = end;
+    }
+}
+
 ProceduralSample
 ChaosLayout::operator()(const coord_def &p, const uint32_t offset) const
 {
@@ -99,26 +191,59 @@ ChaosLayout::operator()(const coord_def &p, const uint32_t offset) const
     return ProceduralSample(p, DNGN_FLOOR, offset + 4096);
 }
 
-ProceduralSample
-RoilingChaosLayout::operator()(const coord_def &p, const uint32_t offset) const
+// The worley noise at integer x and y coordinates along a row.
+static vector<worley::noise_datum> _integer_noise_row(const coord_def &start,
+                                                      int width, double z)
+{
+    vector<double> xs(width);
+    for (int i = 0; i < width; ++i)
+        xs[i] = start.x + i;
+    vector<worley::noise_datum> noise(width);
+    worley::noise_row(xs.data(), width, start.y, z, noise.data());
+    return noise;
+}
+
+static ProceduralSample _roiling_chaos_sample(const coord_def &p,
+                                              const uint32_t offset,
+                                              const worley::noise_datum &n,
+                                              uint32_t seed, uint32_t density,
+                                              double scale)
 {
-    const double scale = (density - 350) + 4800;
-    double x = p.x;
-    double y = p.y;
-    double z = offset / scale;
-    worley::noise_datum n = worley::noise(x, y, z);
     const uint32_t changepoint = offset + _get_changepoint(n, scale);
     ProceduralSample sample = ChaosLayout(n.id[0] + seed, density)(p, offset);
     return ProceduralSample(p, sample.feat(), min(sample.changepoint(), changepoint));
 }
 
 ProceduralSample
-WastesLayout::operator()(const coord_def &p, const uint32_t offset) const
+RoilingChaosLayout::operator()(const coord_def &p, const uint32_t offset) const
 {
+    const double scale = (density - 350) + 4800;
     double x = p.x;
     double y = p.y;
-    double z = offset / 3;
+    double z = offset / scale;
     worley::noise_datum n = worley::noise(x, y, z);
+    return _roiling_chaos_sample(p, offset, n, seed, density, scale);
+}
+
+void RoilingChaosLayout::sample_row(const coord_def &start, int width,
+                                    const uint32_t offset,
+                                    vector<ProceduralSample> &out) const
+{
+    const double scale = (density - 350) + 4800;
+    double z = offset / scale;
+    const vector<worley::noise_datum> noise
+        = _integer_noise_row(start, width, z);
+    for (int i = 0; i < width; ++i)
+    {
+        out.push_back(_roiling_chaos_sample(start + coord_def(i, 0), offset,
+                                            noise[i], seed, density, scale));
+    }
+}
+
+static ProceduralSample _wastes_sample(const coord_def &p,
+                                       const uint32_t offset,
+                                       const worley::noise_datum &n)
+{
     const uint32_t changepoint = offset + _get_changepoint(n, 3);
     ProceduralSample sample = ChaosLayout(n.id[0], 10)(p, offset);
     dungeon_feature_type feat = feat_is_solid(sample.feat())
@@ -127,16 +252,40 @@ WastesLayout::operator()(const coord_def &p, const uint32_t offset) const
 }
 
 ProceduralSample
-RiverLayout::operator()(const coord_def &p, const uint32_t offset) const
+WastesLayout::operator()(const coord_def &p, const uint32_t offset) const
+{
+    double x = p.x;
+    double y = p.y;
+    double z = offset / 3;
+    worley::noise_datum n = worley::noise(x, y, z);
+    return _wastes_sample(p, offset, n);
+}
+
+void WastesLayout::sample_row(const coord_def &start, int width,
+                              const uint32_t offset,
+                              vector<ProceduralSample> &out) const
+{
+    double z = offset / 3;
+    const vector<worley::noise_datum> noise
+        = _integer_noise_row(start, width, z);
+    for (int i = 0; i < width; ++i)
+        out.push_back(_wastes_sample(start + coord_def(i, 0), offset, noise[i]));
+}
+
+// The river feature at p, or DNGN_UNSEEN if p is left to the underlying
+// layout.
+dungeon_feature_type RiverLayout::river_feat(const coord_def &p,
+                                             const uint32_t offset,
+                                             uint32_t &changepoint) const
 {
     const double scale = 10000;
     const double scalar = 90.0;
     double x = (p.x + perlin::fBM(p.x/4.0, p.y/4.0, seed, 5) * 3) / scalar;
     double y = (p.y + perlin::fBM(p.x/4.0 + 3.7, p.y/4.0 + 1.9, seed + 4, 5) * 3) / scalar;
     worley::noise_datum n = worley::noise(x, y, offset / scale + seed);
-    const uint32_t changepoint = offset + _get_changepoint(n, scale);
+    changepoint = offset + _get_changepoint(n, scale);
     if ((n.id[0] ^ n.id[1] ^ seed) % 4)
-        return layout(p, offset);
+        return DNGN_UNSEEN;
 
     double delta = n.distance[1] - n.distance[0];
     if (delta < 1.5/scalar)
@@ -147,20 +296,40 @@ RiverLayout::operator()(const coord_def &p, const uint32_t offset) const
             feat = DNGN_DEEP_WATER;
         if (!(hash % 23))
             feat = DNGN_TREE;
-        return ProceduralSample(p, feat, changepoint);
+        return feat;
     }
-    return layout(p, offset);
+    return DNGN_UNSEEN;
 }
 
 ProceduralSample
-NewAbyssLayout::operator()(const coord_def &p, const uint32_t offset) const
+RiverLayout::operator()(const coord_def &p, const uint32_t offset) const
+{
+    uint32_t changepoint;
+    const dungeon_feature_type feat = river_feat(p, offset, changepoint);
+    if (feat == DNGN_UNSEEN)
+        return layout(p, offset);
+    return ProceduralSample(p, feat, changepoint);
+}
+
+void RiverLayout::sample_row(const coord_def &start, int width,
+                             const uint32_t offset,
+                             vector<ProceduralSample> &out) const
+{
+    // The rivers are domain-distorted per cell, so only the layout
+    // underneath them benefits from sampling by row.
+    vector<dungeon_feature_type> feats(width);
+    vector<uint32_t> changepoints(width);
+    for (int i = 0; i < width; ++i)
+        feats[i] = river_feat(start + coord_def(i, 0), offset, changepoints[i]);
+    _sample_row_with_fallback(start, feats, changepoints, layout, offset, out);
+}
+
+static ProceduralSample _new_abyss_sample(const coord_def &p,
+                                          const uint32_t offset,
+                                          const worley::noise_datum &noise,
+                                          uint32_t seed)
 {
-    const double scale = 1.0 / 3.2;
     uint64_t base = hash3(p.x, p.y, seed);
-    worley::noise_datum noise = worley::noise(
-            p.x * scale,
-            p.y * scale,
-            offset / 1000.0);
     dungeon_feature_type feat = DNGN_FLOOR;
 
     int dist = noise.distance[0] * 100;
@@ -182,6 +351,35 @@ NewAbyssLayout::operator()(const coord_def &p, const uint32_t offset) const
     return ProceduralSample(p, feat, offset + delta);
 }
 
+ProceduralSample
+NewAbyssLayout::operator()(const coord_def &p, const uint32_t offset) const
+{
+    const double scale = 1.0 / 3.2;
+    worley::noise_datum noise = worley::noise(
+            p.x * scale,
+            p.y * scale,
+            offset / 1000.0);
+    return _new_abyss_sample(p, offset, noise, seed);
+}
+
+void NewAbyssLayout::sample_row(const coord_def &start, int width,
+                                const uint32_t offset,
+                                vector<ProceduralSample> &out) const
+{
+    const double scale = 1.0 / 3.2;
+    vector<double> xs(width);
+    for (int i = 0; i < width; ++i)
+        xs[i] = (start.x + i) * scale;
+    vector<worley::noise_datum> noise(width);
+    worley::noise_row(xs.data(), width, start.y * scale, offset / 1000.0,
+                      noise.data());
+    for (int i = 0; i < width; ++i)
+    {
+        out.push_back(_new_abyss_sample(start + coord_def(i, 0), offset,
+                                        noise[i], seed));
+    }
+}
+
 dungeon_feature_type sanitize_feature(dungeon_feature_type feature, bool strict)
 {
     if (feat_is_gate(feature)
@@ -280,6 +478,17 @@ LevelLayout::operator()(const coord_def &p, const uint32_t offset) const
     return ProceduralSample(p, feat, offset + 4096);
 }
 
+void LevelLayout::sample_row(const coord_def &start, int width,
+                             const uint32_t offset,
+                             vector<ProceduralSample> &out) const
+{
+    vector<dungeon_feature_type> feats(width);
+    const vector<uint32_t> changepoints(width, offset + 4096);
+    for (int i = 0; i < width; ++i)
+        feats[i] = grid(clip(start + coord_def(i, 0)));
+    _sample_row_with_fallback(start, feats, changepoints, layout, offset, out);
+}
+
 ProceduralSample
 NoiseLayout::operator()(const coord_def &p, const uint32_t offset) const
 {
@@ -58,6 +58,11 @@ class ProceduralLayout
     public:
         virtual ProceduralSample operator()(const coord_def &p,
             const uint32_t offset = 0) const = 0;
+        // Append the samples for the width cells running in +x from start.
+        // Layouts built on noise override this to share work between
+        // neighbouring cells; the samples must match operator().
+        virtual void sample_row(const coord_def &start, int width,
+            const uint32_t offset, vector<ProceduralSample> &out) const;
         virtual ~ProceduralLayout() { }
 };
 
@@ -101,6 +106,9 @@ class WorleyLayout : public ProceduralLayout
             seed(_seed), layouts(_layouts), scale(_scale) {}
         ProceduralSample operator()(const coord_def &p,
             const uint32_t offset = 0) const override;
+        void sample_row(const coord_def &start, int width,
+            const uint32_t offset,
+            vector<ProceduralSample> &out) const override;
     private:
         const uint32_t seed;
         const vector<const ProceduralLayout*> layouts;
@@ -133,6 +141,9 @@ class RoilingChaosLayout : public ProceduralLayout
             seed(_seed), density(_density) {}
         ProceduralSample operator()(const coord_def &p,
             const uint32_t offset = 0) const override;
+        void sample_row(const coord_def &start, int width,
+            const uint32_t offset,
+            vector<ProceduralSample> &out) const override;
     private:
         const uint32_t seed;
         const uint32_t density;
@@ -145,6 +156,9 @@ class WastesLayout : public ProceduralLayout
         WastesLayout() { };
         ProceduralSample operator()(const coord_def &p,
             const uint32_t offset = 0) const override;
+        void sample_row(const coord_def &start, int width,
+            const uint32_t offset,
+            vector<ProceduralSample> &out) const override;
 };
 
 class RiverLayout : public ProceduralLayout
@@ -154,7 +168,12 @@ class RiverLayout : public ProceduralLayout
             seed(_seed), layout(_layout) {}
         ProceduralSample operator()(const coord_def &p,
             const uint32_t offset = 0) const override;
+        void sample_row(const coord_def &start, int width,
+            const uint32_t offset,
+            vector<ProceduralSample> &out) const override;
     private:
+        dungeon_feature_type river_feat(const coord_def &p,
+            const uint32_t offset, uint32_t &changepoint) const;
         const uint32_t seed;
         const ProceduralLayout &layout;
 };
@@ -166,6 +185,9 @@ class NewAbyssLayout : public ProceduralLayout
         NewAbyssLayout(uint32_t _seed) : seed(_seed) {}
         ProceduralSample operator()(const coord_def &p,
             const uint32_t offset = 0) const override;
+        void sample_row(const coord_def &start, int width,
+            const uint32_t offset,
+            vector<ProceduralSample> &out) const override;
     private:
         const uint32_t seed;
 };
@@ -179,6 +201,9 @@ class LevelLayout : public ProceduralLayout
             const ProceduralLayout &_layout);
         ProceduralSample operator()(const coord_def &p,
             const uint32_t offset = 0) const override;
+        void sample_row(const coord_def &start, int width,
+            const uint32_t offset,
+            vector<ProceduralSample> &out) const override;
     private:
         feature_grid grid;
         uint32_t seed;
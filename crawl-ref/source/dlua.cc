@@ -25,8 +25,7 @@ static int dlua_compiled_chunk_writer(lua_State *ls, const void *p,
 // dlua_chunk
 
 dlua_chunk::dlua_chunk(const string &_context)
-    : file(), chunk(), compiled(), context(_context), first(-1),
-      last(-1), error()
+    : text(), context(_context), first(-1), last(-1), error()
 {
     clear();
 }
@@ -34,7 +33,7 @@ dlua_chunk::dlua_chunk(const string &_context)
 // Initialises a chunk from the function on the top of stack.
 // This function must not be a closure, i.e. must not have any upvalues.
 dlua_chunk::dlua_chunk(lua_State *ls)
-    : file(), chunk(), compiled(), context(), first(-1), last(-1), error()
+    : text(), context(), first(-1), last(-1), error()
 {
     clear();
 
@@ -46,18 +45,34 @@ dlua_chunk::dlua_chunk(lua_State *ls)
         const char *e = lua_tostring(ls, -1);
         error = e? e : "Unknown error compiling chunk";
     }
-    compiled = out.str();
+    edit_text().compiled = out.str();
 }
 
 dlua_chunk dlua_chunk::precompiled(const string &_chunk)
 {
     dlua_chunk dchunk;
-    dchunk.compiled = _chunk;
+    dchunk.edit_text().compiled = _chunk;
     return dchunk;
 }
 
+const dlua_chunk::chunk_text &dlua_chunk::get_text() const
+{
+    static const chunk_text no_text;
+    return text ? *text : no_text;
+}
+
+dlua_chunk::chunk_text &dlua_chunk::edit_text()
+{
+    if (!text)
+        text = make_shared<chunk_text>();
+    else if (text.use_count() > 1)
+        text = make_shared<chunk_text>(*text);
+    return *text;
+}
+
 string dlua_chunk::describe(const string &name) const
 {
+    const string &chunk = get_text().chunk;
     if (chunk.empty())
         return "";
     return make_stringf("function %s()\n%s\nend\n",
@@ -72,18 +87,19 @@ void dlua_chunk::write(writer& outf) const
         return;
     }
 
-    if (!compiled.empty())
+    const chunk_text &t = get_text();
+    if (!t.compiled.empty())
     {
         marshallByte(outf, CT_COMPILED);
-        marshallString4(outf, compiled);
+        marshallString4(outf, t.compiled);
     }
     else
     {
         marshallByte(outf, CT_SOURCE);
-        marshallString4(outf, chunk);
+        marshallString4(outf, t.chunk);
     }
 
-    marshallString4(outf, file);
+    marshallString4(outf, t.file);
     marshallInt(outf, first);
 }
 
@@ -96,28 +112,27 @@ void dlua_chunk::read(reader& inf)
     case CT_EMPTY:
         return;
     case CT_SOURCE:
-        unmarshallString4(inf, chunk);
+        unmarshallString4(inf, edit_text().chunk);
         break;
     case CT_COMPILED:
-        unmarshallString4(inf, compiled);
+        unmarshallString4(inf, edit_text().compiled);
         break;
     }
-    unmarshallString4(inf, file);
+    unmarshallString4(inf, edit_text().file);
     first = unmarshallInt(inf);
 }
 
 void dlua_chunk::clear()
 {
-    file.clear();
-    chunk.clear();
+    text.reset();
     first = last = -1;
     error.clear();
-    compiled.clear();
 }
 
 void dlua_chunk::set_file(const string &s)
 {
-    file = s;
+    if (get_text().file != s)
+        edit_text().file = s;
 }
 
 void dlua_chunk::add(int line, const string &s)
@@ -125,6 +140,7 @@ void dlua_chunk::add(int line, const string &s)
     if (first == -1)
         first = line;
 
+    string &chunk = edit_text().chunk;
     if (line != last && last != -1)
     {
         while (last++ < line)
@@ -138,7 +154,7 @@ void dlua_chunk::add(int line, const string &s)
 
 void dlua_chunk::set_chunk(const string &s)
 {
-    chunk = s;
+    edit_text().chunk = s;
 }
 
 int dlua_chunk::check_op(CLua &interp, int err)
@@ -149,21 +165,24 @@ int dlua_chunk::check_op(CLua &interp, int err)
 
 int dlua_chunk::load(CLua &interp)
 {
-    if (!compiled.empty())
+    const chunk_text &t = get_text();
+    if (!t.compiled.empty())
     {
         return check_op(interp,
-                         interp.loadbuffer(compiled.c_str(), compiled.length(),
+                         interp.loadbuffer(t.compiled.c_str(),
+                                           t.compiled.length(),
                                            context.c_str()));
     }
 
     if (empty())
     {
-        chunk.clear();
+        if (!t.chunk.empty())
+            edit_text().chunk.clear();
         return E_CHUNK_LOAD_FAILURE;
     }
 
     int err = check_op(interp,
-                        interp.loadstring(chunk.c_str(), context.c_str()));
+                        interp.loadstring(t.chunk.c_str(), context.c_str()));
     if (err)
         return err;
     ostringstream out;
@@ -174,7 +193,22 @@ int dlua_chunk::load(CLua &interp)
         error = e? e : "Unknown error compiling chunk";
         lua_pop(interp, 2);
     }
-    compiled = out.str();
+    edit_text().compiled = out.str();
+    return err;
+}
+
+// Compiles a source chunk to bytecode without running it, so that it is
+// written out (and later loaded) in compiled form. A chunk that fails to
+// compile is left as source, to report its error when it is actually used.
+int dlua_chunk::compile(CLua &interp)
+{
+    if (!get_text().compiled.empty() || empty())
+        return 0;
+
+    lua_stack_cleaner clean(interp);
+    const int err = load(interp);
+    if (err)
+        edit_text().compiled.clear();
     return err;
 }
 
@@ -206,7 +240,8 @@ string dlua_chunk::orig_error() const
 
 bool dlua_chunk::empty() const
 {
-    return compiled.empty() && trimmed_string(chunk).empty();
+    const chunk_text &t = get_text();
+    return t.compiled.empty() && trimmed_string(t.chunk).empty();
 }
 
 bool dlua_chunk::rewrite_chunk_errors(string &s) const
@@ -264,6 +299,7 @@ string dlua_chunk::rewrite_chunk_prefix(const string &line, bool skip_body) cons
         pe = lns + newlnum.length();
     }
 
+    const string &file = get_text().file;
     return s.substr(0, ps) + (file.empty()? context : file) + ":"
         + (skip_body? s.substr(lns, pe - lns)
                     : s.substr(lns));
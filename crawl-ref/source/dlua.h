@@ -23,9 +23,15 @@ class writer;
 class dlua_chunk
 {
 private:
-    string file;
-    string chunk;
-    string compiled;
+    // Vaults are copied for every placement try, so the text of a chunk is
+    // shared between copies, and only copied when one of them changes it.
+    struct chunk_text
+    {
+        string file;
+        string chunk;
+        string compiled;
+    };
+    shared_ptr<chunk_text> text;
     string context;
     int first, last;     // First and last lines of the original source.
 
@@ -38,6 +44,8 @@ private:
 
 private:
     int check_op(CLua &, int);
+    const chunk_text &get_text() const;
+    chunk_text &edit_text();
     string rewrite_chunk_prefix(const string &line, bool skip_body = false) const;
     string get_chunk_prefix(const string &s) const;
 
@@ -56,17 +64,18 @@ public:
     void set_chunk(const string &s);
 
     int load(CLua &interp);
+    int compile(CLua &interp);
     int run(CLua &interp);
     int load_call(CLua &interp, const char *function);
     void set_file(const string &s);
 
-    const string &lua_string() const { return chunk; }
+    const string &lua_string() const { return get_text().chunk; }
     string orig_error() const;
     bool rewrite_chunk_errors(string &err) const;
 
     bool empty() const;
 
-    const string &compiled_chunk() const { return compiled; }
+    const string &compiled_chunk() const { return get_text().compiled; }
 
     void write(writer&) const;
     void read(reader&);
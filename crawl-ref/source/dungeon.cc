@@ -433,8 +433,16 @@ static bool _build_level_vetoable(bool enable_random_maps)
 {
 #ifdef DEBUG_STATISTICS
     mapstat_report_map_build_start();
+    mapstat_timer timer("level (built or failed)");
 #endif
 
+    // A veto always restarts from a blank level rather than rolling back
+    // to some checkpoint taken before the failing vault. By the time a
+    // vault can veto (exit connection, post-place hooks) apply_grid has
+    // already placed its monsters, items, markers and Lua listeners, and
+    // registered uniques and map tags; restoring all of that piecemeal
+    // would be more fragile than this reset, which is cheap next to the
+    // build itself. Seeded levels also depend on the retry sequence.
     dgn_reset_level(enable_random_maps);
 
     if (player_in_branch(BRANCH_TEMPLE))
@@ -449,6 +457,9 @@ static bool _build_level_vetoable(bool enable_random_maps)
     catch (dgn_veto_exception& e)
     {
         dgn_record_veto(e);
+#ifdef DEBUG_STATISTICS
+        timer.set_phase("level (vetoed)");
+#endif
 
         // try not to lose any ghosts that have been placed
         save_ghosts(ghost_demon::find_ghosts(false), false);
@@ -615,6 +626,9 @@ bool dgn_make_transporters_from_markers()
 // fixups.
 static void _dgn_postprocess_level()
 {
+#ifdef DEBUG_STATISTICS
+    mapstat_timer timer("postprocess");
+#endif
     shoals_postprocess_level();
     _builder_assertions();
     _calc_density();
@@ -922,54 +936,104 @@ static bool _dgn_square_is_ever_passable(const coord_def &c)
     return _dgn_square_is_passable(c);
 }
 
-static inline void _dgn_point_record_stub(const coord_def &) { }
-
-template <class point_record>
-static bool _dgn_fill_zone(
-    const coord_def &start, int zone,
-    point_record &record_point,
-    bool (*passable)(const coord_def &) = _dgn_square_is_passable,
-    bool (*iswanted)(const coord_def &) = nullptr)
+// Connected components of the squares satisfying a passability predicate,
+// found in one raster pass with union-find (8-connectivity, inside
+// map_bounds). Zones are numbered from 1 in order of their first square in a
+// row-major scan -- the same numbering a flood fill seeded from each
+// unvisited square in turn would give. Impassable squares are zone 0.
+class dgn_zone_map
 {
-    bool ret = false;
-    list<coord_def> points[2];
-    int cur = 0;
-    int found_points = 0;
+public:
+    explicit dgn_zone_map(bool (*passable)(const coord_def &));
 
-    // No bounds checks, assuming the level has at least one layer of
-    // rock border.
+    int count() const { return sizes.size() - 1; }
+    int zone(const coord_def &c) const { return labels(c); }
+    int size(int z) const { return sizes[z]; }
+    // Indexed by zone: whether any square of the zone satisfies `wanted`.
+    vector<bool> zones_containing(bool (*wanted)(const coord_def &)) const;
+
+private:
+    FixedArray<int, GXM, GYM> labels;
+    vector<int> sizes;
+};
+
+dgn_zone_map::dgn_zone_map(bool (*passable)(const coord_def &))
+    : labels(0), sizes(1, 0)
+{
+    // The neighbours of a square that a row-major scan has already visited.
+    static const coord_def earlier[] =
+        { coord_def(-1, 0), coord_def(-1, -1), coord_def(0, -1),
+          coord_def(1, -1) };
 
-    for (points[cur].push_back(start); !points[cur].empty();)
+    vector<int> parent(1, 0);
+    auto find = [&parent](int l)
     {
-        for (const auto &c : points[cur])
-        {
-            travel_point_distance[c.x][c.y] = zone;
-            found_points++;
+        while (parent[l] != l)
+            l = parent[l] = parent[parent[l]];
+        return l;
+    };
 
-            if (iswanted && iswanted(c))
-                ret = true;
+    for (int y = 0; y < GYM; ++y)
+        for (int x = 0; x < GXM; ++x)
+        {
+            const coord_def c(x, y);
+            if (!map_bounds(c) || !passable(c))
+                continue;
 
-            for (adjacent_iterator ai(c); ai; ++ai)
+            int label = 0;
+            for (const coord_def &delta : earlier)
             {
-                const coord_def& cp = *ai;
-                if (!map_bounds(cp)
-                    || travel_point_distance[cp.x][cp.y] || !passable(cp))
-                {
+                const coord_def n = c + delta;
+                if (!map_bounds(n) || !labels(n))
                     continue;
+                const int other = find(labels(n));
+                if (!label)
+                    label = other;
+                else if (other != label)
+                {
+                    parent[max(label, other)] = min(label, other);
+                    label = min(label, other);
                 }
+            }
+            if (!label)
+            {
+                label = parent.size();
+                parent.push_back(label);
+            }
+            labels(c) = label;
+        }
 
-                travel_point_distance[cp.x][cp.y] = zone;
-                record_point(cp);
-                points[!cur].push_back(cp);
+    // Renumber merged labels in order of first appearance.
+    vector<int> zone_of(parent.size(), 0);
+    for (int y = 0; y < GYM; ++y)
+        for (int x = 0; x < GXM; ++x)
+        {
+            int &label = labels[x][y];
+            if (!label)
+                continue;
+            const int root = find(label);
+            if (!zone_of[root])
+            {
+                zone_of[root] = sizes.size();
+                sizes.push_back(0);
             }
+            label = zone_of[root];
+            sizes[label]++;
         }
+}
 
-        points[cur].clear();
-        cur = !cur;
-    }
-    dprf("Zone %d contains %d points from seed %d,%d", zone, found_points,
-        start.x, start.y);
-    return ret;
+vector<bool> dgn_zone_map::zones_containing(
+    bool (*wanted)(const coord_def &)) const
+{
+    vector<bool> found(sizes.size(), false);
+    for (int y = 0; y < GYM; ++y)
+        for (int x = 0; x < GXM; ++x)
+        {
+            const int z = labels[x][y];
+            if (z && !found[z] && wanted(coord_def(x, y)))
+                found[z] = true;
+        }
+    return found;
 }
 
 static bool _is_perm_down_stair(const coord_def &c)
@@ -1078,94 +1142,81 @@ static bool _is_exit_stair(const coord_def &c)
 // stairs in them.
 //
 // If fill is non-zero, it fills any disconnected regions with fill.
-//
-// TODO: refactor this to something more usable
-static int _process_disconnected_zones(int x1, int y1, int x2, int y2,
+static int _process_disconnected_zones(const dgn_zone_map &zones,
                 bool choose_stairless,
                 dungeon_feature_type fill,
-                bool (*passable)(const coord_def &) = _dgn_square_is_passable,
                 bool (*fill_check)(const coord_def &) = nullptr,
                 int fill_small_zones = 0)
 {
-    memset(travel_point_distance, 0, sizeof(travel_distance_grid_t));
-    int nzones = 0;
-    int ngood = 0;
-    for (int y = y1; y <= y2 ; ++y)
+    vector<bool> found_exit_stair;
+    if (choose_stairless)
     {
-        for (int x = x1; x <= x2; ++x)
-        {
-            if (!map_bounds(x, y)
-                || travel_point_distance[x][y]
-                || !passable(coord_def(x, y)))
-            {
-                continue;
-            }
+        found_exit_stair = zones.zones_containing(at_branch_bottom() ?
+                                                  _is_upwards_exit_stair :
+                                                  _is_exit_stair);
+    }
 
-            int zone_size = 0;
-            auto inc_zone_size = [&zone_size](const coord_def &) { zone_size++; };
-
-            const bool found_exit_stair =
-                _dgn_fill_zone(coord_def(x, y), ++nzones,
-                               inc_zone_size,
-                               passable,
-                               choose_stairless ? (at_branch_bottom() ?
-                                                   _is_upwards_exit_stair :
-                                                   _is_exit_stair) : nullptr);
-
-            // If we want only stairless zones, screen out zones that did
-            // have stairs.
-            if (choose_stairless && found_exit_stair)
-                ++ngood;
-            else if (fill
-                && (fill_small_zones <= 0 || zone_size <= fill_small_zones))
+    const int nzones = zones.count();
+    int ngood = 0;
+    for (int zone = 1; zone <= nzones; ++zone)
+    {
+        // If we want only stairless zones, screen out zones that did
+        // have stairs.
+        // (The flood fill this used to use didn't count a zone's first
+        // square, so neither does the small zone limit.)
+        if (choose_stairless && found_exit_stair[zone])
+            ++ngood;
+        else if (fill
+            && (fill_small_zones <= 0
+                || zones.size(zone) - 1 <= fill_small_zones))
+        {
+            // Don't fill in areas connected to vaults.
+            // We want vaults to be accessible; if the area is disconneted
+            // from the rest of the level, this will cause the level to be
+            // vetoed later on.
+            bool veto = false;
+            vector<coord_def> coords;
+            dprf("Filling zone %d", zone);
+            for (int fy = 0; fy < GYM; ++fy)
             {
-                // Don't fill in areas connected to vaults.
-                // We want vaults to be accessible; if the area is disconneted
-                // from the rest of the level, this will cause the level to be
-                // vetoed later on.
-                bool veto = false;
-                vector<coord_def> coords;
-                dprf("Filling zone %d", nzones);
-                for (int fy = y1; fy <= y2 ; ++fy)
+                for (int fx = 0; fx < GXM; ++fx)
                 {
-                    for (int fx = x1; fx <= x2; ++fx)
+                    const coord_def fc(fx, fy);
+                    if (zones.zone(fc) == zone)
                     {
-                        if (travel_point_distance[fx][fy] == nzones)
+                        if (map_masked(fc, MMT_VAULT))
                         {
-                            if (map_masked(coord_def(fx, fy), MMT_VAULT))
-                            {
-                                veto = true;
-                                break;
-                            }
-                            else if (!fill_check || fill_check(coord_def(fx, fy)))
-                                coords.emplace_back(fx, fy);
+                            veto = true;
+                            break;
                         }
+                        else if (!fill_check || fill_check(fc))
+                            coords.push_back(fc);
                     }
-                    if (veto)
-                        break;
                 }
-                if (!veto)
+                if (veto)
+                    break;
+            }
+            if (!veto)
+            {
+                for (auto c : coords)
                 {
-                    for (auto c : coords)
+                    // For normal builder scenarios items shouldn't be
+                    // placed yet, but it could (if not careful) happen
+                    // in weirder cases, such as the abyss.
+                    if (env.igrid(c) != NON_ITEM
+                        && (!feat_is_traversable(fill)
+                            || feat_destroys_items(fill)))
                     {
-                        // For normal builder scenarios items shouldn't be
-                        // placed yet, but it could (if not careful) happen
-                        // in weirder cases, such as the abyss.
-                        if (env.igrid(c) != NON_ITEM
-                            && (!feat_is_traversable(fill)
-                                || feat_destroys_items(fill)))
-                        {
-                            // Alternatively, could place floor instead?
-                            dprf("Nuke item stack at (%d, %d)", c.x, c.y);
-                            lose_item_stack(c);
-                        }
-                        _set_grd(c, fill);
-                        if (env.mgrid(c) != NON_MONSTER
-                            && !env.mons[env.mgrid(c)].is_habitable_feat(fill))
-                        {
-                            monster_die(env.mons[env.mgrid(c)],
-                                        KILL_RESET, NON_MONSTER, false, true);
-                        }
+                        // Alternatively, could place floor instead?
+                        dprf("Nuke item stack at (%d, %d)", c.x, c.y);
+                        lose_item_stack(c);
+                    }
+                    _set_grd(c, fill);
+                    if (env.mgrid(c) != NON_MONSTER
+                        && !env.mons[env.mgrid(c)].is_habitable_feat(fill))
+                    {
+                        monster_die(env.mons[env.mgrid(c)],
+                                    KILL_RESET, NON_MONSTER, false, true);
                     }
                 }
             }
@@ -1175,10 +1226,23 @@ static int _process_disconnected_zones(int x1, int y1, int x2, int y2,
     return nzones - ngood;
 }
 
+static int _process_disconnected_zones(bool choose_stairless,
+                dungeon_feature_type fill,
+                bool (*passable)(const coord_def &) = _dgn_square_is_passable,
+                bool (*fill_check)(const coord_def &) = nullptr,
+                int fill_small_zones = 0)
+{
+    // Filling a zone only changes squares of that zone, so labelling the
+    // whole level up front gives the same zones as discovering them as we go.
+    const dgn_zone_map zones(passable);
+    return _process_disconnected_zones(zones, choose_stairless, fill,
+                                       fill_check, fill_small_zones);
+}
+
 int dgn_count_tele_zones(bool choose_stairless)
 {
     dprf("Counting teleport zones");
-    return _process_disconnected_zones(0, 0, GXM-1, GYM-1, choose_stairless,
+    return _process_disconnected_zones(choose_stairless,
                                     DNGN_UNSEEN, _dgn_square_is_tele_connected);
 }
 
@@ -1188,7 +1252,7 @@ int dgn_count_tele_zones(bool choose_stairless)
 int dgn_count_disconnected_zones(bool choose_stairless,
                                  dungeon_feature_type fill)
 {
-    return _process_disconnected_zones(0, 0, GXM-1, GYM-1, choose_stairless,
+    return _process_disconnected_zones(choose_stairless,
                                        fill);
 }
 
@@ -1197,7 +1261,7 @@ static void _fill_small_disconnected_zones()
     // debugging tip: change the feature to something like lava that will be
     // very noticeable.
     // TODO: make even more agressive, up to ~25?
-    _process_disconnected_zones(0, 0, GXM-1, GYM-1, true, DNGN_ROCK_WALL,
+    _process_disconnected_zones(true, DNGN_ROCK_WALL,
                                        _dgn_square_is_passable,
                                        _dgn_square_is_boring,
                                        10);
@@ -2088,88 +2152,75 @@ static bool _fixup_stone_stairs(bool preserve_vault_stairs)
 static bool _add_feat_if_missing(bool (*iswanted)(const coord_def &),
                                  dungeon_feature_type feat)
 {
-    memset(travel_point_distance, 0, sizeof(travel_distance_grid_t));
-    int nzones = 0;
-    for (int y = 0; y < GYM; ++y)
-        for (int x = 0; x < GXM; ++x)
-        {
-            // [ds] Use dgn_square_is_passable instead of
-            // dgn_square_travel_ok here, for we'll otherwise
-            // fail on floorless isolated pocket in vaults (like the
-            // altar surrounded by deep water), and trigger the assert
-            // downstairs.
-            const coord_def gc(x, y);
-            if (!map_bounds(x, y)
-                || travel_point_distance[x][y] // already covered previously
-                || !_dgn_square_is_passable(gc))
-            {
-                continue;
-            }
+    // [ds] Use dgn_square_is_passable instead of
+    // dgn_square_travel_ok here, for we'll otherwise
+    // fail on floorless isolated pocket in vaults (like the
+    // altar surrounded by deep water), and trigger the assert
+    // downstairs.
+    const dgn_zone_map zones(_dgn_square_is_passable);
+    const vector<bool> has_wanted = zones.zones_containing(iswanted);
+    for (int zone = 1; zone <= zones.count(); ++zone)
+    {
+        if (has_wanted[zone])
+            continue;
 
-            if (_dgn_fill_zone(gc, ++nzones, _dgn_point_record_stub,
-                               _dgn_square_is_passable, iswanted))
+        bool found_feature = false;
+        for (rectangle_iterator ri(0); ri; ++ri)
+        {
+            if (env.grid(*ri) == feat && zones.zone(*ri) == zone)
             {
-                continue;
+                found_feature = true;
+                break;
             }
+        }
 
-            bool found_feature = false;
-            for (rectangle_iterator ri(0); ri; ++ri)
-            {
-                if (env.grid(*ri) == feat
-                    && travel_point_distance[ri->x][ri->y] == nzones)
-                {
-                    found_feature = true;
-                    break;
-                }
-            }
+        if (found_feature)
+            continue;
 
-            if (found_feature)
+        int i = 0;
+        while (i++ < 2000)
+        {
+            coord_def rnd;
+            rnd.x = random2(GXM);
+            rnd.y = random2(GYM);
+            if (env.grid(rnd) != DNGN_FLOOR)
                 continue;
 
-            int i = 0;
-            while (i++ < 2000)
-            {
-                coord_def rnd;
-                rnd.x = random2(GXM);
-                rnd.y = random2(GYM);
-                if (env.grid(rnd) != DNGN_FLOOR)
-                    continue;
+            if (zones.zone(rnd) != zone)
+                continue;
 
-                if (travel_point_distance[rnd.x][rnd.y] != nzones)
-                    continue;
+            _set_grd(rnd, feat);
+            found_feature = true;
+            break;
+        }
 
-                _set_grd(rnd, feat);
-                found_feature = true;
-                break;
-            }
+        if (found_feature)
+            continue;
 
-            if (found_feature)
+        for (rectangle_iterator ri(0); ri; ++ri)
+        {
+            if (env.grid(*ri) != DNGN_FLOOR)
                 continue;
 
-            for (rectangle_iterator ri(0); ri; ++ri)
-            {
-                if (env.grid(*ri) != DNGN_FLOOR)
-                    continue;
-
-                if (travel_point_distance[ri->x][ri->y] != nzones)
-                    continue;
+            if (zones.zone(*ri) != zone)
+                continue;
 
-                _set_grd(*ri, feat);
-                found_feature = true;
-                break;
-            }
+            _set_grd(*ri, feat);
+            found_feature = true;
+            break;
+        }
 
-            if (found_feature)
-                continue;
+        if (found_feature)
+            continue;
 
 #ifdef DEBUG_DIAGNOSTICS
-            dump_map("debug.map", true, true);
+        dump_map("debug.map", true, true);
 #endif
-            // [ds] Too many normal cases trigger this ASSERT, including
-            // rivers that surround a stair with deep water.
-            // die("Couldn't find region.");
-            return false;
-        }
+        // [ds] Too many normal cases trigger this ASSERT, including
+        // rivers that surround a stair with deep water.
+        // die("Couldn't find region.");
+        return false;
+    }
 
     return true;
 }
@@ -2230,14 +2281,27 @@ static bool _branch_needs_stairs()
 
 static void _dgn_verify_connectivity(unsigned nvaults)
 {
+#ifdef DEBUG_STATISTICS
+    mapstat_timer timer("connectivity");
+#endif
+    const bool placed_vaults = dgn_zones
+                               && nvaults != env.level_vaults.size();
+    if (placed_vaults && !player_in_branch(BRANCH_ABYSS))
+        _fill_small_disconnected_zones();
+
+    const bool check_stairless = player_in_connected_branch()
+        && !(branches[you.where_are_you].branch_flags & brflag::islanded);
+
+    // Both checks below look at the same zones, so only label them once.
+    unique_ptr<dgn_zone_map> zones;
+    if (placed_vaults || check_stairless)
+        zones.reset(new dgn_zone_map(_dgn_square_is_passable));
+
     // After placing vaults, make sure parts of the level have not been
     // disconnected.
-    if (dgn_zones && nvaults != env.level_vaults.size())
+    if (placed_vaults)
     {
-        if (!player_in_branch(BRANCH_ABYSS))
-            _fill_small_disconnected_zones();
-
-        const int newzones = dgn_count_disconnected_zones(false);
+        const int newzones = zones->count();
 
 #ifdef DEBUG_STATISTICS
         ostringstream vlist;
@@ -2264,9 +2328,8 @@ static void _dgn_verify_connectivity(unsigned nvaults)
     }
 
     // Also check for isolated regions that have no stairs.
-    if (player_in_connected_branch()
-        && !(branches[you.where_are_you].branch_flags & brflag::islanded)
-        && dgn_count_disconnected_zones(true) > 0)
+    if (check_stairless
+        && _process_disconnected_zones(*zones, true, DNGN_UNSEEN) > 0)
     {
         throw dgn_veto_exception("Isolated areas with no stairs.");
     }
@@ -2942,6 +3005,9 @@ static bool _pan_level()
 // to place more vaults after this
 static bool _builder_by_type()
 {
+#ifdef DEBUG_STATISTICS
+    mapstat_timer timer("layout");
+#endif
     if (player_in_branch(BRANCH_ABYSS))
     {
         generate_abyss();
@@ -3369,6 +3435,9 @@ static void _slime_connectivity_fixup()
 // Place vaults with CHANCE: that want to be placed on this level.
 static void _place_chance_vaults()
 {
+#ifdef DEBUG_STATISTICS
+    mapstat_timer timer("chance vaults");
+#endif
     const level_id &lid(level_id::current());
     mapref_vector maps = random_chance_maps_in_depth(lid);
     // [ds] If there are multiple CHANCE maps that share an luniq_ or
@@ -3406,6 +3475,9 @@ static void _place_chance_vaults()
 
 static void _place_minivaults()
 {
+#ifdef DEBUG_STATISTICS
+    mapstat_timer timer("minivaults");
+#endif
     const map_def *vault = nullptr;
     // First place the vault requested with &P
     if (you.props.exists("force_minivault")
@@ -3712,6 +3784,9 @@ static bool _place_vault_by_tag(const string &tag)
 
 static void _place_branch_entrances(bool use_vaults)
 {
+#ifdef DEBUG_STATISTICS
+    mapstat_timer timer("branch entrances");
+#endif
     // Find what branch entrances are already placed, and what branch
     // entrances could be placed here.
     bool branch_entrance_placed[NUM_BRANCHES];
@@ -3794,6 +3869,9 @@ static void _place_branch_entrances(bool use_vaults)
 
 static void _place_extra_vaults()
 {
+#ifdef DEBUG_STATISTICS
+    mapstat_timer timer("extra vaults");
+#endif
     int tries = 0;
     while (true)
     {
@@ -3824,6 +3902,9 @@ static void _place_extra_vaults()
 // Return the number of uniques placed.
 static int _place_uniques()
 {
+#ifdef DEBUG_STATISTICS
+    mapstat_timer timer("uniques");
+#endif
 #ifdef DEBUG_UNIQUE_PLACEMENT
     FILE *ostat = fopen("unique_placement.log", "a");
     fprintf(ostat, "--- Looking to place uniques on %s\n",
@@ -4022,6 +4103,9 @@ bool door_vetoed(const coord_def pos)
 
 static void _builder_monsters()
 {
+#ifdef DEBUG_STATISTICS
+    mapstat_timer timer("monsters");
+#endif
     if (player_in_branch(BRANCH_TEMPLE))
         return;
 
@@ -4118,6 +4202,9 @@ static void _randomly_place_item(int item)
  */
 static void _builder_items()
 {
+#ifdef DEBUG_STATISTICS
+    mapstat_timer timer("items");
+#endif
     int i = 0;
     object_class_type specif_type = OBJ_RANDOM;
     int items_levels = env.absdepth0;
@@ -4514,13 +4601,13 @@ static const vault_placement *_build_vault_impl(const map_def *vault,
     if (!build_only && (placed_vault_orientation != MAP_ENCOMPASS || is_layout)
         && player_in_branch(BRANCH_SWAMP))
     {
-        _process_disconnected_zones(0, 0, GXM-1, GYM-1, true, DNGN_MANGROVE);
+        _process_disconnected_zones(true, DNGN_MANGROVE);
         // do a second pass to remove tele closets consisting of deep water
         // created by the first pass -- which will not fill in deep water
         // because it is treated as impassable.
         // TODO: get zonify to prevent these?
         // TODO: does this come up anywhere outside of swamp?
-        _process_disconnected_zones(0, 0, GXM-1, GYM-1, true, DNGN_MANGROVE,
+        _process_disconnected_zones(true, DNGN_MANGROVE,
                 _dgn_square_is_ever_passable);
     }
 
@@ -6771,20 +6858,7 @@ static bool _fixup_interlevel_connectivity()
     has_down[0] = has_down[1] = has_down[2] = false;
 
     // Find up stairs and down stairs on the current level.
-    memset(travel_point_distance, 0, sizeof(travel_distance_grid_t));
-    int nzones = 0;
-    for (rectangle_iterator ri(0); ri; ++ri)
-    {
-        if (!map_bounds(ri->x, ri->y)
-            || travel_point_distance[ri->x][ri->y]
-            || !dgn_square_travel_ok(*ri))
-        {
-            continue;
-        }
-
-        _dgn_fill_zone(*ri, ++nzones, _dgn_point_record_stub,
-                       dgn_square_travel_ok, nullptr);
-    }
+    const dgn_zone_map zones(dgn_square_travel_ok);
 
     int max_region = 0;
     for (rectangle_iterator ri(0); ri; ++ri)
@@ -6802,7 +6876,7 @@ static bool _fixup_interlevel_connectivity()
             int idx = feat - DNGN_STONE_STAIRS_DOWN_I;
             if (down_region[idx] == -1)
             {
-                down_region[idx] = travel_point_distance[ri->x][ri->y];
+                down_region[idx] = zones.zone(*ri);
                 down_gc[idx] = *ri;
                 max_region = max(down_region[idx], max_region);
             }
@@ -6820,7 +6894,7 @@ static bool _fixup_interlevel_connectivity()
             int idx = feat - DNGN_STONE_STAIRS_UP_I;
             if (up_region[idx] == -1)
             {
-                up_region[idx] = travel_point_distance[ri->x][ri->y];
+                up_region[idx] = zones.zone(*ri);
                 up_gc[idx] = *ri;
                 max_region = max(up_region[idx], max_region);
             }
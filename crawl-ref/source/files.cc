@@ -19,6 +19,7 @@
 
 #include <algorithm>
 #include <cctype>
+#include <chrono>
 #include <cerrno>
 #include <cstdio>
 #include <cstdlib>
@@ -131,6 +132,7 @@ static bool _ghost_version_compatible(const save_version &version);
 static bool _restore_tagged_chunk(package *save, const string &name,
                                   tag_type tag, const char* complaint);
 static bool _read_char_chunk(package *save);
+static bool _tagged_chunk_version_compatible(reader &inf, string* reason);
 
 static bool _convert_obsolete_species();
 
@@ -1696,6 +1698,13 @@ bool generate_level(const level_id &l)
 // rng for other branches anyways.
 //
 // How should this relate to logical_branch_order etc?
+//
+// Although each branch has its own rng stream, the order here is part of the
+// seed's identity and branches can't be built independently (e.g. in
+// parallel): uniques placed, `you.uniq_map_tags`/`uniq_map_names`, unrandart
+// and other unique item generation, and the dgn_* / dlua state all carry over
+// from one level build to the next, so what gets placed in a later branch
+// depends on everything generated before it.
 static const vector<branch_type> branch_generation_order =
 {
     BRANCH_TEMPLE,
@@ -3118,6 +3127,232 @@ bool restore_game(const string& filename)
     }
 }
 
+struct save_bench_chunk
+{
+    save_bench_chunk(const string &n, tag_type t)
+        : name(n), tag(t), stored(0), raw(0), rewritten(0), recompressed(0),
+          inflate_usecs(0), read_usecs(0), write_usecs(0), deflate_usecs(0),
+          read_allocs(0), write_allocs(0)
+    {
+    }
+
+    string name;
+    tag_type tag;
+    plen_t stored;          // compressed size in the save file
+    plen_t raw;             // uncompressed size in the save file
+    size_t rewritten;       // uncompressed size after a re-save
+    size_t recompressed;    // compressed size after a re-save
+    uint64_t inflate_usecs, read_usecs, write_usecs, deflate_usecs;
+    uint64_t read_allocs, write_allocs;
+};
+
+static uint64_t _usecs_since(chrono::steady_clock::time_point start)
+{
+    return chrono::duration_cast<chrono::microseconds>(
+               chrono::steady_clock::now() - start).count();
+}
+
+// Allocation counts need the instrumented operator new; without it they
+// read as 0 and are printed as "n/a".
+static uint64_t _alloc_count()
+{
+#ifdef DEBUG_ALLOCATIONS
+    return debug_alloc_count();
+#else
+    return 0;
+#endif
+}
+
+static uint64_t _alloc_bytes()
+{
+#ifdef DEBUG_ALLOCATIONS
+    return debug_alloc_bytes();
+#else
+    return 0;
+#endif
+}
+
+static string _alloc_column(uint64_t value)
+{
+#ifdef DEBUG_ALLOCATIONS
+    return to_string(value);
+#else
+    UNUSED(value);
+    return "n/a";
+#endif
+}
+
+static void _benchmark_save_chunk(package &save, save_bench_chunk &chunk)
+{
+    auto start = chrono::steady_clock::now();
+    vector<char> data;
+    {
+        chunk_reader in(&save, chunk.name);
+        in.read_all(data);
+    }
+    chunk.inflate_usecs += _usecs_since(start);
+    chunk.raw = data.size();
+    chunk.stored = save.get_chunk_compressed_length(chunk.name);
+
+    if (chunk.tag == TAG_LEVEL)
+    {
+        const level_id lid = level_id::parse_level_id(chunk.name);
+        you.where_are_you = lid.branch;
+        you.depth = lid.depth;
+    }
+
+    uint64_t allocs = _alloc_count();
+    start = chrono::steady_clock::now();
+    {
+        reader inf(vector<unsigned char>(data.begin(), data.end()));
+        string reason;
+        if (!_tagged_chunk_version_compatible(inf, &reason))
+            end(1, false, "%s: %s", chunk.name.c_str(), reason.c_str());
+        crawl_state.minor_version = inf.getMinorVersion();
+        tag_read(inf, chunk.tag);
+        inf.fail_if_not_eof(chunk.name);
+    }
+    chunk.read_usecs += _usecs_since(start);
+    chunk.read_allocs += _alloc_count() - allocs;
+
+    allocs = _alloc_count();
+    start = chrono::steady_clock::now();
+    vector<unsigned char> out;
+    {
+        writer outw(&out);
+        write_save_version(outw, save_version::current());
+        tag_write(chunk.tag, outw);
+    }
+    chunk.write_usecs += _usecs_since(start);
+    chunk.write_allocs += _alloc_count() - allocs;
+    chunk.rewritten = out.size();
+
+#ifdef USE_ZLIB
+    start = chrono::steady_clock::now();
+    uLongf zlen = compressBound(out.size());
+    vector<Bytef> zbuf(zlen);
+    if (compress2(&zbuf[0], &zlen, &out[0], out.size(), Z_DEFAULT_COMPRESSION)
+        != Z_OK)
+    {
+        end(1, false, "%s: compression failed", chunk.name.c_str());
+    }
+    chunk.deflate_usecs += _usecs_since(start);
+    chunk.recompressed = zlen;
+#endif
+}
+
+/**
+ * Repeatedly load and re-save the player and level chunks of a save, and
+ * print how long each step took. The save file itself is never modified.
+ *
+ * @param name        A save file name or character name.
+ * @param iterations  How many times to load and save each chunk.
+ */
+void benchmark_save(const string& name, int iterations)
+{
+    string filename = name;
+    // Check for the exact filename first, then go by char name.
+    if (!file_exists(filename))
+        filename = get_savedir_filename(filename);
+    if (!file_exists(filename))
+        end(1, false, "No save file found for '%s'.", name.c_str());
+
+    package save(filename.c_str(), false);
+    if (!_read_char_chunk(&save))
+    {
+        end(1, false, "'%s' is from an incompatible version (%s).",
+            filename.c_str(), you.prev_save_version.c_str());
+    }
+
+    vector<string> names = save.list_chunks();
+    sort(names.begin(), names.end(), numcmpstr);
+    vector<save_bench_chunk> chunks;
+    for (const string &chunk : names)
+    {
+        if (chunk == "you")
+            chunks.emplace_back(chunk, TAG_YOU);
+        else
+        {
+            try
+            {
+                level_id::parse_level_id(chunk);
+                chunks.emplace_back(chunk, TAG_LEVEL);
+            }
+            catch (const bad_level_id &)
+            {
+                // Not a level: stashes, notes, etc.
+            }
+        }
+    }
+
+    // Level chunks can only be read with the player in place.
+    _restore_tagged_chunk(&save, "you", TAG_YOU, "Save data is invalid.");
+
+    tag_profile_data profile;
+    unwind_var<tag_profile_data *> profiling(tag_profile, &profile);
+    const uint64_t allocs = _alloc_count();
+    const uint64_t alloc_bytes = _alloc_bytes();
+    const auto start = chrono::steady_clock::now();
+
+    for (int i = 0; i < iterations; ++i)
+        for (save_bench_chunk &chunk : chunks)
+            _benchmark_save_chunk(save, chunk);
+
+    const double total_ms = _usecs_since(start) / 1000.0;
+    const double per_iter = 1000.0 * iterations;
+
+    printf("Save benchmark for %s, version %s, %d iteration(s).\n",
+           filename.c_str(), you.prev_save_version.c_str(), iterations);
+    printf("Sizes are in bytes; times are milliseconds per iteration.\n\n");
+    printf("%-12s %8s %8s %8s %8s %8s %8s %8s %8s %9s %9s\n",
+           "chunk", "stored", "raw", "resaved", "recomp", "inflate", "read",
+           "write", "deflate", "allocs/r", "allocs/w");
+    save_bench_chunk total("total", TAG_NO_TAG);
+    for (const save_bench_chunk &c : chunks)
+    {
+        printf("%-12s %8u %8u %8u %8u %8.2f %8.2f %8.2f %8.2f %9s %9s\n",
+               c.name.c_str(), c.stored, c.raw, (unsigned)c.rewritten,
+               (unsigned)c.recompressed, c.inflate_usecs / per_iter,
+               c.read_usecs / per_iter, c.write_usecs / per_iter,
+               c.deflate_usecs / per_iter,
+               _alloc_column(c.read_allocs / iterations).c_str(),
+               _alloc_column(c.write_allocs / iterations).c_str());
+        total.stored += c.stored;
+        total.raw += c.raw;
+        total.rewritten += c.rewritten;
+        total.recompressed += c.recompressed;
+        total.inflate_usecs += c.inflate_usecs;
+        total.read_usecs += c.read_usecs;
+        total.write_usecs += c.write_usecs;
+        total.deflate_usecs += c.deflate_usecs;
+        total.read_allocs += c.read_allocs;
+        total.write_allocs += c.write_allocs;
+    }
+    printf("%-12s %8u %8u %8u %8u %8.2f %8.2f %8.2f %8.2f %9s %9s\n\n",
+           total.name.c_str(), total.stored, total.raw,
+           (unsigned)total.rewritten, (unsigned)total.recompressed,
+           total.inflate_usecs / per_iter, total.read_usecs / per_iter,
+           total.write_usecs / per_iter, total.deflate_usecs / per_iter,
+           _alloc_column(total.read_allocs / iterations).c_str(),
+           _alloc_column(total.write_allocs / iterations).c_str());
+
+    printf("%-6s %-16s %10s %8s\n", "", "section", "ms/iter", "calls");
+    for (const auto &entry : profile.read)
+    {
+        printf("%-6s %-16s %10.3f %8d\n", "read", entry.first.c_str(),
+               entry.second.usecs / per_iter, entry.second.calls);
+    }
+    for (const auto &entry : profile.write)
+    {
+        printf("%-6s %-16s %10.3f %8d\n", "write", entry.first.c_str(),
+               entry.second.usecs / per_iter, entry.second.calls);
+    }
+
+    printf("\nWall time: %.1f ms; %s allocations, %s bytes allocated.\n",
+           total_ms, _alloc_column(_alloc_count() - allocs).c_str(),
+           _alloc_column(_alloc_bytes() - alloc_bytes).c_str());
+}
+
 static void _load_level(const level_id &level)
 {
     // Load the given level.
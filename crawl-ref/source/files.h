@@ -102,6 +102,7 @@ save_version get_save_version(reader &file);
 
 bool save_exists(const string& filename);
 bool restore_game(const string& filename);
+void benchmark_save(const string& name, int iterations);
 
 bool is_existing_level(const level_id &level);
 
@@ -401,6 +401,7 @@ const vector<GameOption*> game_options::build_options_list()
         new BoolGameOption(SIMPLE_NAME(tile_level_map_hide_messages), true),
         new BoolGameOption(SIMPLE_NAME(tile_level_map_hide_sidebar), false),
         new BoolGameOption(SIMPLE_NAME(tile_web_mouse_control), true),
+        new IntGameOption(SIMPLE_NAME(tile_web_max_fps), 30, 0, 1000),
         new StringGameOption(SIMPLE_NAME(tile_font_crt_family), "monospace"),
         new StringGameOption(SIMPLE_NAME(tile_font_msg_family), "monospace"),
         new StringGameOption(SIMPLE_NAME(tile_font_stat_family), "monospace"),
@@ -3993,6 +3994,7 @@ enum commandline_option_type
     CLO_OBJSTAT,
     CLO_ITERATIONS,
     CLO_FORCE_MAP,
+    CLO_JOBS,
     CLO_ARENA,
     CLO_DUMP_MAPS,
     CLO_TEST,
@@ -4022,10 +4024,12 @@ enum commandline_option_type
     CLO_SAVE_JSON,
     CLO_GAMETYPES_JSON,
     CLO_EDIT_BONES,
+    CLO_SAVE_BENCH,
 #ifdef USE_TILE_WEB
     CLO_WEBTILES_SOCKET,
     CLO_AWAIT_CONNECTION,
     CLO_PRINT_WEBTILES_OPTIONS,
+    CLO_WEBTILES_RECORD,
 #endif
 
     CLO_NOPS
@@ -4035,14 +4039,15 @@ static const char *cmd_ops[] =
 {
     "scores", "name", "species", "background", "dir", "rc", "rcdir", "tscores",
     "vscores", "scorefile", "morgue", "macro", "mapstat", "dump-disconnect",
-    "objstat", "iters", "force-map", "arena", "dump-maps", "test", "script",
+    "objstat", "iters", "force-map", "jobs", "arena", "dump-maps", "test", "script",
     "builddb", "help", "version", "seed", "pregen", "save-version", "sprint",
     "extra-opt-first", "extra-opt-last", "sprint-map", "edit-save",
     "print-charset", "tutorial", "wizard", "explore", "no-save", "gdb",
     "no-gdb", "nogdb", "throttle", "no-throttle", "playable-json",
-    "branches-json", "save-json", "gametypes-json", "bones",
+    "branches-json", "save-json", "gametypes-json", "bones", "save-bench",
 #ifdef USE_TILE_WEB
     "webtiles-socket", "await-connection", "print-webtiles-options",
+    "webtiles-record",
 #endif
 };
 
@@ -4794,6 +4799,7 @@ bool parse_args(int argc, char **argv, bool rc_only)
 
     SysEnv.rcdirs.clear();
     SysEnv.map_gen_iters = 0;
+    SysEnv.map_gen_jobs = 1;
 
     if (argc < 2)           // no args!
         return true;
@@ -4954,7 +4960,7 @@ bool parse_args(int argc, char **argv, bool rc_only)
             end(1, false, "%s", dbg_stat_err);
 #endif
         case CLO_ITERATIONS:
-#ifdef DEBUG_STATISTICS
+            // Also used by -save-bench, so available in all builds.
             if (!next_is_param || !isadigit(*next_arg))
                 end(1, false, "Integer argument required for -%s\n", arg);
             else
@@ -4966,9 +4972,6 @@ bool parse_args(int argc, char **argv, bool rc_only)
                     SysEnv.map_gen_iters = 10000;
                 nextUsed = true;
             }
-#else
-            end(1, false, "%s", dbg_stat_err);
-#endif
             break;
 
         case CLO_FORCE_MAP:
@@ -4985,6 +4988,20 @@ bool parse_args(int argc, char **argv, bool rc_only)
 #endif
             break;
 
+        case CLO_JOBS:
+#ifdef DEBUG_STATISTICS
+            if (!next_is_param || !isadigit(*next_arg))
+                end(1, false, "Integer argument required for -%s\n", arg);
+            else
+            {
+                SysEnv.map_gen_jobs = max(1, min(atoi(next_arg), 256));
+                nextUsed = true;
+            }
+#else
+            end(1, false, "%s", dbg_stat_err);
+#endif
+            break;
+
         case CLO_ARENA:
             if (!rc_only)
             {
@@ -5172,6 +5189,18 @@ bool parse_args(int argc, char **argv, bool rc_only)
             _edit_bones(argc - current - 1, argv + current + 1);
             end(0);
 
+        case CLO_SAVE_BENCH:
+            if (!next_is_param)
+                end(1, false, "Save name required for -%s\n", arg);
+            SysEnv.save_bench = next_arg;
+            if (!SysEnv.map_gen_iters)
+                SysEnv.map_gen_iters = 10;
+#ifdef USE_TILE_LOCAL
+            crawl_state.tiles_disabled = true;
+#endif
+            nextUsed = true;
+            break;
+
         case CLO_SEED:
             if (!next_is_param)
             {
@@ -5245,6 +5274,13 @@ bool parse_args(int argc, char **argv, bool rc_only)
                 end(0);
             }
             break;
+
+        case CLO_WEBTILES_RECORD:
+            if (!next_is_param)
+                end(1, false, "String argument required for -%s\n", arg);
+            nextUsed            = true;
+            tiles.m_record_name = next_arg;
+            break;
 #endif
 
         case CLO_PRINT_CHARSET:
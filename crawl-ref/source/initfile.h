@@ -61,8 +61,11 @@ public:
     vector<string> cmd_args;
 
     int map_gen_iters;
+    int map_gen_jobs;              // Worker processes for -mapstat/-objstat.
     unique_ptr<depth_ranges> map_gen_range;
 
+    string save_bench;             // Save to benchmark, see -save-bench.
+
     vector<string> extra_opts_first;
     vector<string> extra_opts_last;
 
@@ -1564,7 +1564,8 @@ void delay(unsigned int time)
 
 #ifdef USE_TILE_WEB
     tiles.redraw();
-    if (time)
+    // No point asking the client to pause on a frame it never got.
+    if (time && !tiles.frame_deferred())
     {
         tiles.send_message("{\"msg\":\"delay\",\"t\":%d}", time);
         tiles.flush_messages();
@@ -500,6 +500,10 @@ static void _show_commandline_options_help()
     puts("  -macro <dir>          directory to save/find macro.txt");
     puts("  -version              Crawl version (and compilation info)");
     puts("  -save-version <name>  Save file version for the given player");
+    puts("  -save-bench <name>    Time loading and saving every level of the given");
+    puts("                        save");
+    puts("  -iters <num>          For -save-bench (and -mapstat, -objstat), set the");
+    puts("                        number of iterations; default 10 for -save-bench");
     puts("  -sprint               select Sprint");
     puts("  -sprint-map <name>    preselect a Sprint map");
     puts("  -tutorial             select the Tutorial");
@@ -557,10 +561,13 @@ static void _show_commandline_options_help()
     puts("  -objstat [<levels>] run monster and item stats on the given range "
          "of levels");
     puts("      Defaults to entire dungeon; same level syntax as -mapstat.");
-    puts("  -iters <num>        For -mapstat and -objstat, set the number of "
-         "iterations");
     puts("  -force-map <map>    For -mapstat and -objstat, alway choose the "
          "      given map on every level.");
+#ifdef UNIX
+    puts("  -jobs <num>         For -mapstat and -objstat, split the iterations "
+         "over");
+    puts("                      this many worker processes");
+#endif
 #endif
     puts("");
     puts("Miscellaneous options:");
@@ -1534,28 +1534,34 @@ void map_lines::resolve_shuffle(const string &shufflage)
     if (toshuffle.empty() || shuffled.empty())
         return;
 
-    for (string &s : lines)
-    {
-        for (char &c : s)
-        {
-            string::size_type pos = toshuffle.find(c);
-            if (pos != string::npos)
-                c = shuffled[pos];
-        }
-    }
+    // Each glyph maps to the shuffled glyph at its first occurrence.
+    char replacement[256];
+    for (int i = 0; i < 256; ++i)
+        replacement[i] = i;
+    for (int pos = toshuffle.length() - 1; pos >= 0; --pos)
+        replacement[static_cast<unsigned char>(toshuffle[pos])] = shuffled[pos];
+
+    replace_glyphs(replacement);
 }
 
 void map_lines::clear(const string &clearchars)
+{
+    char replacement[256];
+    for (int i = 0; i < 256; ++i)
+        replacement[i] = i;
+    for (char c : clearchars)
+        replacement[static_cast<unsigned char>(c)] = ' ';
+
+    replace_glyphs(replacement);
+}
+
+// Replace every glyph in the map through a table indexed by glyph, in a
+// single pass rather than searching a key string for every cell.
+void map_lines::replace_glyphs(const char replacement[256])
 {
     for (string &s : lines)
-    {
         for (char &c : s)
-        {
-            string::size_type pos = clearchars.find(c);
-            if (pos != string::npos)
-                c = ' ';
-        }
-    }
+            c = replacement[static_cast<unsigned char>(c)];
 }
 
 void map_lines::normalise(char fillch)
@@ -1582,14 +1588,16 @@ void map_lines::rotate(bool clockwise)
               ye = clockwise? -1 : (int) lines.size(),
               yi = clockwise? -1 : 1;
 
+    newlines.reserve(map_width);
     for (int i = xs; i != xe; i += xi)
     {
         string line;
+        line.reserve(lines.size());
 
         for (int j = ys; j != ye; j += yi)
             line += lines[j][i];
 
-        newlines.push_back(line);
+        newlines.push_back(move(line));
     }
 
     if (overlay)
@@ -1602,7 +1610,7 @@ void map_lines::rotate(bool clockwise)
     }
 
     map_width = lines.size();
-    lines     = newlines;
+    lines     = move(newlines);
     rotate_markers(clockwise);
     solid_checked = false;
 }
@@ -1655,11 +1663,7 @@ void map_lines::vmirror()
     const int midpoint = vsize / 2;
 
     for (int i = 0; i < midpoint; ++i)
-    {
-        string temp = lines[i];
-        lines[i] = lines[vsize - 1 - i];
-        lines[vsize - 1 - i] = temp;
-    }
+        lines[i].swap(lines[vsize - 1 - i]);
 
     if (overlay)
     {
@@ -2179,6 +2183,16 @@ bool depth_ranges::is_usable_in(const level_id &lid) const
     return any_matched;
 }
 
+// Whether any level of branch `br` could satisfy is_usable_in(). Ranges with
+// no branch are given in absolute depth, so they can match anywhere.
+bool depth_ranges::may_match_branch(branch_type br) const
+{
+    for (const level_range &lr : depths)
+        if (!lr.deny && (lr.branch == br || lr.branch == NUM_BRANCHES))
+            return true;
+    return false;
+}
+
 void depth_ranges::add_depths(const depth_ranges &other_depths)
 {
     depths.insert(depths.end(),
@@ -2217,7 +2231,7 @@ void map_def::init()
     name.clear();
     description.clear();
     order = INT_MAX;
-    tags.clear();
+    tags.reset();
     place.clear();
     depths.clear();
     prelude.clear();
@@ -2574,6 +2588,18 @@ void map_def::set_file(const string &s)
     cache_name = get_cache_name(s);
 }
 
+// Compile the map's Lua chunks, so that the des cache stores bytecode and
+// trying the map doesn't have to parse its Lua again.
+void map_def::compile_lua()
+{
+    prelude.compile(dlua);
+    mapchunk.compile(dlua);
+    main.compile(dlua);
+    validate.compile(dlua);
+    veto.compile(dlua);
+    epilogue.compile(dlua);
+}
+
 string map_def::run_lua(bool run_main)
 {
     dlua_set_map mset(this);
@@ -2791,7 +2817,7 @@ string map_def::validate_map_placeable()
     // Ok, the map wants to be placed by tag. In this case it should have
     // at least one tag that's not a map flag.
     bool has_selectable_tag = false;
-    for (const string &piece : tags)
+    for (const string &piece : get_tag_set())
     {
         if (_map_tag_is_selectable(piece))
         {
@@ -3338,14 +3364,14 @@ bool map_def::has_tag(const string &tagwanted) const
 #ifdef DEBUG_TAG_PROFILING
     _profile_inc_tag(tagwanted);
 #endif
-    return tags.count(tagwanted) > 0;
+    return get_tag_set().count(tagwanted) > 0;
 }
 
 bool map_def::has_tag_prefix(const string &prefix) const
 {
     if (prefix.empty())
         return false;
-    for (const auto &tag : tags)
+    for (const auto &tag : get_tag_set())
         if (starts_with(tag, prefix))
             return true;
     return false;
@@ -3355,7 +3381,7 @@ bool map_def::has_tag_suffix(const string &suffix) const
 {
     if (suffix.empty())
         return false;
-    for (const auto &tag : tags)
+    for (const auto &tag : get_tag_set())
         if (ends_with(tag, suffix))
             return true;
     return false;
@@ -3363,22 +3389,41 @@ bool map_def::has_tag_suffix(const string &suffix) const
 
 const unordered_set<string> map_def::get_tags_unsorted() const
 {
-    return tags;
+    return get_tag_set();
+}
+
+const unordered_set<string> &map_def::get_tag_set() const
+{
+    static const unordered_set<string> no_tags;
+    return tags ? *tags : no_tags;
+}
+
+unordered_set<string> &map_def::edit_tags()
+{
+    if (!tags)
+        tags = make_shared<unordered_set<string>>();
+    else if (tags.use_count() > 1)
+        tags = make_shared<unordered_set<string>>(*tags);
+    return *tags;
 }
 
 const vector<string> map_def::get_tags() const
 {
     // this might seem inefficient, but get_tags is not called very much; the
     // hotspot revealed by profiling is actually has_tag checks.
-    vector<string> result(tags.begin(), tags.end());
+    const unordered_set<string> &tag_set = get_tag_set();
+    vector<string> result(tag_set.begin(), tag_set.end());
     sort(result.begin(), result.end());
     return result;
 }
 
 void map_def::add_tags(const string &tag)
 {
-    auto parsed_tags = parse_tags(tag);
-    tags.insert(parsed_tags.begin(), parsed_tags.end());
+    // Maps rerun their TAGS every time they are resolved, so avoid copying
+    // a shared tag set when there is nothing new in it.
+    for (const string &t : parse_tags(tag))
+        if (!get_tag_set().count(t))
+            edit_tags().insert(t);
     update_cached_tags();
 }
 
@@ -3387,14 +3432,15 @@ bool map_def::remove_tags(const string &tag)
     bool removed = false;
     auto parsed_tags = parse_tags(tag);
     for (auto &t : parsed_tags)
-        removed = tags.erase(t) || removed; // would iterator overload be ok?
+        if (get_tag_set().count(t))
+            removed = edit_tags().erase(t) || removed;
     update_cached_tags();
     return removed;
 }
 
 void map_def::clear_tags()
 {
-    tags.clear();
+    tags.reset();
     update_cached_tags();
 }
 
@@ -459,6 +459,7 @@ private:
 
     void resolve_shuffle(const string &shuffle);
     void clear(const string &clear);
+    void replace_glyphs(const char replacement[256]);
     void subst(string &s, subst_spec &spec);
     void subst(subst_spec &);
     void nsubst(nsubst_spec &);
@@ -976,6 +977,7 @@ public:
     void clear() { depths.clear(); }
     bool empty() const { return depths.empty(); }
     bool is_usable_in(const level_id &lid) const;
+    bool may_match_branch(branch_type br) const;
     void add_depth(const level_range &range) { depths.push_back(range); }
     void add_depths(const depth_ranges &other_ranges);
     string describe() const;
@@ -1157,7 +1159,9 @@ public:
     string          file;
 
 private:
-    unordered_set<string>     tags;
+    // Shared by the copies made for each placement try until one of them
+    // changes its tags; use get_tag_set() and edit_tags() to get at them.
+    shared_ptr<unordered_set<string>> tags;
     // This map has been loaded from an index, and not fully realised.
     bool            index_only;
     mutable long    cache_offset;
@@ -1213,6 +1217,7 @@ public:
 
     void set_file(const string &s);
     string run_lua(bool skip_main);
+    void compile_lua();
     bool run_hook(const string &hook_name, bool die_on_lua_error = false);
     bool run_postplace_hook(bool die_on_lua_error = false);
     void copy_hooks_from(const map_def &other_map, const string &hook_name);
@@ -1269,7 +1274,7 @@ public:
     template <typename TagIterator>
     bool has_all_tags(TagIterator begin, TagIterator end) const
     {
-        if (tags.empty() || begin == end) // legacy behaviour for empty case
+        if (get_tag_set().empty() || begin == end) // legacy behaviour for empty case
             return false;
         for ( ; begin != end; ++begin)
             if (!has_tag(*begin))
@@ -1342,6 +1347,8 @@ private:
     string validate_map_placeable();
     bool has_exit() const;
     void update_cached_tags();
+    const unordered_set<string> &get_tag_set() const;
+    unordered_set<string> &edit_tags();
 };
 
 const int CHANCE_ROLL = 10000;
@@ -8,6 +8,7 @@
 #include "maps.h"
 
 #include <algorithm>
+#include <bitset>
 #include <cstdlib>
 #include <cstring>
 #include <sys/param.h>
@@ -68,6 +69,71 @@ point_vector map_anchor_points;
 
 static map_vector vdefs;
 
+typedef vector<unsigned> vault_indices;
+
+// An index over vdefs, so that map selection only has to run
+// map_selector::accept() over maps that could possibly be accepted. Buckets
+// hold vdefs indices in ascending order, so filtering a bucket gives exactly
+// the same list as filtering all of vdefs. Rebuilt on demand whenever vdefs
+// changes.
+struct vault_selection_index
+{
+    bool dirty = true;
+    vault_indices by_depth[NUM_BRANCHES]; // DEPTH: could match the branch
+    vault_indices by_place[NUM_BRANCHES]; // PLACE: could match the branch
+    map<string, vault_indices> by_tag;
+};
+
+static vault_selection_index vault_index;
+
+static void _invalidate_vault_index()
+{
+    vault_index.dirty = true;
+}
+
+static const vault_selection_index &_vault_index()
+{
+    if (!vault_index.dirty)
+        return vault_index;
+
+    vault_index = vault_selection_index();
+    for (unsigned i = 0, size = vdefs.size(); i < size; ++i)
+    {
+        const map_def &mapdef = vdefs[i];
+        for (int br = 0; br < NUM_BRANCHES; ++br)
+        {
+            const branch_type branch = static_cast<branch_type>(br);
+            if (mapdef.depths.may_match_branch(branch))
+                vault_index.by_depth[br].push_back(i);
+            if (mapdef.place.may_match_branch(branch))
+                vault_index.by_place[br].push_back(i);
+        }
+        for (const string &tag : mapdef.get_tags_unsorted())
+            vault_index.by_tag[tag].push_back(i);
+    }
+    vault_index.dirty = false;
+    return vault_index;
+}
+
+// Maps that could have all of `tags`: the smallest bucket of any one of them.
+// Like map_def::has_all_tags(), wanting no tags at all matches nothing.
+static const vault_indices &_maps_with_all_tags(
+    const unordered_set<string> &tags)
+{
+    static const vault_indices none;
+    const auto &by_tag = _vault_index().by_tag;
+    const vault_indices *best = &none;
+    for (const string &tag : tags)
+    {
+        auto it = by_tag.find(tag);
+        if (it == by_tag.end())
+            return none;
+        if (best == &none || it->second.size() < best->size())
+            best = &it->second;
+    }
+    return *best;
+}
+
 // Parameter array that vault code can use.
 string_vector map_parameters;
 
@@ -107,6 +173,7 @@ map_section_type vault_main(vault_placement &place, const map_def *vault,
 #ifdef DEBUG_STATISTICS
     if (crawl_state.map_stat_gen)
         mapstat_report_map_try(*vault);
+    mapstat_timer timer(*vault);
 #endif
 
     // Return value of MAP_NONE forces dungeon.cc to regenerate the
@@ -432,6 +499,73 @@ static bool _is_transporter_place(const coord_def &c)
                  || !m->property(TRANSPORTER_DEST_NAME_PROP).empty());
 }
 
+// The tags of a map that decide which squares it may be placed over.
+struct vault_overwrite_rules
+{
+    explicit vault_overwrite_rules(const map_def &map)
+        : water_ok(map.has_tag("water_ok") || player_in_branch(BRANCH_SWAMP)),
+          overwrite_other_vaults(map.has_tag("overwrite_floor_cell")),
+          replace_portals(map.has_tag("replace_portal"))
+    {
+    }
+
+    bool water_ok;
+    bool overwrite_other_vaults;
+    bool replace_portals;
+};
+
+// Can a non-blank glyph of a map be placed on cp?
+static bool _vault_square_safe(const coord_def &cp,
+                               const vault_overwrite_rules &rules)
+{
+    // Unconditionally allow portal placements to work.
+    if (rules.replace_portals && _is_portal_place(cp))
+        return true;
+
+    if (!rules.overwrite_other_vaults)
+    {
+        // Also check adjacent squares for collisions, because being next
+        // to another vault may block off one of this vault's exits.
+        for (adjacent_iterator ai(cp); ai; ++ai)
+        {
+            if (map_bounds(*ai) && (env.level_map_mask(*ai) & MMT_VAULT))
+                return false;
+        }
+    }
+    else if (env.grid(cp) != DNGN_FLOOR || env.pgrid(cp) & FPROP_NO_TELE_INTO
+                                   || _is_transporter_place(cp))
+    {
+        // Don't place overwrite_floor_cell vaults on anything but floor or
+        // on squares that can't be teleported into, because
+        // overwrite_floor_cell is used for things that are expected to be
+        // connected. Don't place on transporter markers, because these will
+        // later themselves overwrite whatever feature this vault places.
+        return false;
+    }
+
+    // Don't overwrite features other than floor, rock wall, doors,
+    // nor water, if !water_ok.
+    if (!_may_overwrite_feature(cp, rules.water_ok))
+        return false;
+
+    // Don't overwrite monsters or items, either!
+    if (monster_at(cp) || env.igrid(cp) != NON_ITEM)
+        return false;
+
+    // If in Slime, don't let stairs end up next to minivaults,
+    // so that they don't possibly end up next to unsafe walls.
+    if (player_in_branch(BRANCH_SLIME))
+    {
+        for (adjacent_iterator ai(cp); ai; ++ai)
+        {
+            if (map_bounds(*ai) && feat_is_stair(env.grid(*ai)))
+                return false;
+        }
+    }
+
+    return true;
+}
+
 static bool _map_safe_vault_place(const map_def &map,
                                   const coord_def &c,
                                   const coord_def &size)
@@ -443,14 +577,7 @@ static bool _map_safe_vault_place(const map_def &map,
     if (map.is_overwritable_layout())
         return true;
 
-    const bool water_ok =
-        map.has_tag("water_ok") || player_in_branch(BRANCH_SWAMP);
-
-    const bool vault_can_overwrite_other_vaults =
-        map.has_tag("overwrite_floor_cell");
-
-    const bool vault_can_replace_portals =
-        map.has_tag("replace_portal");
+    const vault_overwrite_rules rules(map);
 
     const vector<string> &lines = map.map.get_lines();
     for (rectangle_iterator ri(c, c + size - 1); ri; ++ri)
@@ -461,55 +588,21 @@ static bool _map_safe_vault_place(const map_def &map,
         if (lines[dp.y][dp.x] == ' ')
             continue;
 
-        // Unconditionally allow portal placements to work.
-        if (vault_can_replace_portals && _is_portal_place(cp))
-            continue;
-
-        if (!vault_can_overwrite_other_vaults)
-        {
-            // Also check adjacent squares for collisions, because being next
-            // to another vault may block off one of this vault's exits.
-            for (adjacent_iterator ai(cp); ai; ++ai)
-            {
-                if (map_bounds(*ai) && (env.level_map_mask(*ai) & MMT_VAULT))
-                    return false;
-            }
-        }
-        else if (env.grid(cp) != DNGN_FLOOR || env.pgrid(cp) & FPROP_NO_TELE_INTO
-                                       || _is_transporter_place(cp))
-        {
-            // Don't place overwrite_floor_cell vaults on anything but floor or
-            // on squares that can't be teleported into, because
-            // overwrite_floor_cell is used for things that are expected to be
-            // connected. Don't place on transporter markers, because these will
-            // later themselves overwrite whatever feature this vault places.
-            return false;
-        }
-
-        // Don't overwrite features other than floor, rock wall, doors,
-        // nor water, if !water_ok.
-        if (!_may_overwrite_feature(cp, water_ok))
+        if (!_vault_square_safe(cp, rules))
             return false;
-
-        // Don't overwrite monsters or items, either!
-        if (monster_at(cp) || env.igrid(cp) != NON_ITEM)
-            return false;
-
-        // If in Slime, don't let stairs end up next to minivaults,
-        // so that they don't possibly end up next to unsafe walls.
-        if (player_in_branch(BRANCH_SLIME))
-        {
-            for (adjacent_iterator ai(cp); ai; ++ai)
-            {
-                if (map_bounds(*ai) && feat_is_stair(env.grid(*ai)))
-                    return false;
-            }
-        }
     }
 
     return true;
 }
 
+// Would a non-blank glyph of a minivault on ci connect it to the level?
+static bool _minivault_square_connects(const coord_def &ci,
+                                       bool replace_portals)
+{
+    return _may_overwrite_feature(ci, false, false)
+           || replace_portals && _is_portal_place(ci);
+}
+
 static bool _connected_minivault_place(const coord_def &c,
                                        const vault_placement &place)
 {
@@ -518,6 +611,7 @@ static bool _connected_minivault_place(const coord_def &c,
 
     // Must not be completely isolated.
     const vector<string> &lines = place.map.map.get_lines();
+    const bool replace_portals = place.map.has_tag("replace_portal");
 
     for (rectangle_iterator ri(c, c + place.size - 1); ri; ++ri)
     {
@@ -526,17 +620,69 @@ static bool _connected_minivault_place(const coord_def &c,
         if (lines[ci.y - c.y][ci.x - c.x] == ' ')
             continue;
 
-        if (_may_overwrite_feature(ci, false, false)
-            || (place.map.has_tag("replace_portal")
-                && _is_portal_place(ci)))
-        {
+        if (_minivault_square_connects(ci, replace_portals))
             return true;
-        }
     }
 
     return false;
 }
 
+// Minivault placement tries up to hundreds of random spots. Once the failed
+// tries have checked about as many squares as there are in the placement
+// window, it pays to classify every square of the window once, packed a
+// row to a bitset, and test each further spot a vault row at a time.
+typedef bitset<GXM> level_row_bits;
+
+class minivault_place_planes
+{
+public:
+    // Squares within margin of the edge are never classified: no vault
+    // placed by _find_minivault_place reaches them.
+    minivault_place_planes(const vault_placement &place, bool check_place,
+                           int margin)
+        : check_safe(check_place && !place.map.is_overwritable_layout()),
+          footprint(place.size.y)
+    {
+        const vector<string> &lines = place.map.map.get_lines();
+        for (int y = 0; y < place.size.y; ++y)
+            for (int x = 0; x < place.size.x; ++x)
+                if (lines[y][x] != ' ')
+                    footprint[y].set(x);
+
+        const vault_overwrite_rules rules(place.map);
+        for (int y = margin; y < GYM - margin; ++y)
+            for (int x = margin; x < GXM - margin; ++x)
+            {
+                const coord_def c(x, y);
+                if (check_safe)
+                    safe[y][x] = _vault_square_safe(c, rules);
+                connects[y][x] = _minivault_square_connects(c,
+                                                        rules.replace_portals);
+            }
+    }
+
+    // Both _map_safe_vault_place (if checking) and
+    // _connected_minivault_place for the map placed at c.
+    bool fits(const coord_def &c) const
+    {
+        bool connected = false;
+        for (int y = 0, ysize = footprint.size(); y < ysize; ++y)
+        {
+            const level_row_bits row = footprint[y] << c.x;
+            if (check_safe && (row & ~safe[c.y + y]).any())
+                return false;
+            connected = connected || (row & connects[c.y + y]).any();
+        }
+        return connected;
+    }
+
+private:
+    const bool check_safe;
+    vector<level_row_bits> footprint;
+    level_row_bits safe[GYM];
+    level_row_bits connects[GYM];
+};
+
 coord_def find_portal_place(const vault_placement *place, bool check_place)
 {
     vector<coord_def> candidates;
@@ -578,6 +724,16 @@ static coord_def _find_minivault_place(
     // The spotty connector in the Shoals needs one more space to work.
     const int margin = MAPGEN_BORDER * 2 + player_in_branch(BRANCH_SHOALS);
 
+    // Lua may substitute its own placement check, which the planes can't
+    // stand in for.
+    const bool can_use_planes = !place.size.zero()
+        && (!check_place || map_place_valid == _map_safe_vault_place);
+    // A failed try checks at most the vault's squares; building the planes
+    // costs a check of every square in the window.
+    const int window_area = (GXM - 2 * margin) * (GYM - 2 * margin);
+    const int vault_area = place.size.x * place.size.y;
+    unique_ptr<minivault_place_planes> planes;
+
     // Find a target area which can be safely overwritten.
     for (int tries = 0; tries < 600; ++tries)
     {
@@ -585,6 +741,22 @@ static coord_def _find_minivault_place(
         v1.x = random_range(margin, GXM - margin - place.size.x);
         v1.y = random_range(margin, GYM - margin - place.size.y);
 
+        if (!planes && can_use_planes && tries * vault_area >= window_area)
+        {
+            planes.reset(new minivault_place_planes(place, check_place,
+                                                    margin));
+        }
+
+        if (planes)
+        {
+            if (planes->fits(v1))
+                return v1;
+#ifdef DEBUG_MINIVAULT_PLACEMENT
+            mprf(MSGCH_DIAGNOSTICS, "Skipping (%d,%d): no fit", v1.x, v1.y);
+#endif
+            continue;
+        }
+
         if (check_place && !map_place_valid(place.map, v1, place.size))
         {
 #ifdef DEBUG_MINIVAULT_PLACEMENT
@@ -760,8 +932,9 @@ mapref_vector find_maps_for_tag(const string &tag,
     level_id place = level_id::current();
     unordered_set<string> tag_set = parse_tags(tag);
 
-    for (const map_def &mapdef : vdefs)
+    for (unsigned i : _maps_with_all_tags(tag_set))
     {
+        const map_def &mapdef = vdefs[i];
         if (mapdef.has_all_tags(tag_set.begin(), tag_set.end())
             && !mapdef.has_tag("dummy")
             && (!check_depth || _debug_ignore_depth
@@ -788,6 +961,7 @@ private:
 
 public:
     bool accept(const map_def &md) const;
+    const vault_indices &candidates() const;
     void announce(const map_def *map) const;
 
     bool valid() const
@@ -940,6 +1114,23 @@ bool map_selector::accept(const map_def &mapdef) const
     }
 }
 
+// The subset of vdefs that accept() needs to look at.
+const vault_indices &map_selector::candidates() const
+{
+    const vault_selection_index &index = _vault_index();
+    switch (sel)
+    {
+    case PLACE:
+        return index.by_place[place.branch];
+    case DEPTH:
+    case DEPTH_AND_CHANCE:
+        return index.by_depth[place.branch];
+    case TAG:
+    default:
+        return _maps_with_all_tags(parse_tags(tag));
+    }
+}
+
 void map_selector::announce(const map_def *vault) const
 {
 #ifdef DEBUG_DIAGNOSTICS
@@ -980,15 +1171,13 @@ string vault_chance_tag(const map_def &map)
     return "";
 }
 
-typedef vector<unsigned> vault_indices;
-
 static vault_indices _eligible_maps_for_selector(const map_selector &sel)
 {
     vault_indices eligible;
 
     if (sel.valid())
     {
-        for (unsigned i = 0, size = vdefs.size(); i < size; ++i)
+        for (unsigned i : sel.candidates())
             if (sel.accept(vdefs[i]))
                 eligible.push_back(i);
     }
@@ -1301,6 +1490,13 @@ static bool _verify_map_full(const string &base, time_t mtime)
     return verify_file_version(base + ".dsc", mtime);
 }
 
+// The .idx files are already the compiled, once-per-version form of the
+// vault list: each process reads only the index fields (name, tags, depths,
+// chances, prelude) here, and the map body is pulled from the .dsc file by
+// map_def::load() only when the map is actually used. Sharing the index
+// between processes via mmap would need map_def itself to be a flat,
+// pointer-free structure, which its strings, Lua chunks and unordered_set of
+// tags are not.
 static bool _load_map_index(const string& cache, const string &base,
                             time_t mtime)
 {
@@ -1349,6 +1545,7 @@ static bool _load_map_index(const string& cache, const string &base,
     const int nmaps = unmarshallShort(inf);
     const int nexist = vdefs.size();
     vdefs.resize(nexist + nmaps, map_def());
+    _invalidate_vault_index();
     for (int i = 0; i < nmaps; ++i)
     {
         map_def &vdef(vdefs[nexist + i]);
@@ -1417,7 +1614,10 @@ static void _write_map_full(const string &filebase, size_t vs, size_t ve,
     marshallByte(outf, WORD_LEN);
     marshallSigned(outf, mtime);
     for (size_t i = vs; i < ve; ++i)
+    {
+        vdefs[i].compile_lua();
         vdefs[i].write_full(outf);
+    }
     fclose(fp);
 }
 
@@ -1532,6 +1732,7 @@ void reread_maps()
 
     // BOOM!
     vdefs.clear();
+    _invalidate_vault_index();
     map_files_read.clear();
     read_maps();
 }
@@ -1551,6 +1752,7 @@ void add_parsed_map(const map_def &md)
 
     map.fixup();
     vdefs.push_back(map);
+    _invalidate_vault_index();
 }
 
 void run_map_global_preludes()
@@ -1579,6 +1781,7 @@ void run_map_local_preludes()
             }
         }
     }
+    _invalidate_vault_index();
 }
 
 const map_def *map_by_index(int index)
@@ -599,6 +599,7 @@ public:
     bool        tile_level_map_hide_messages;
     bool        tile_level_map_hide_sidebar;
     bool        tile_web_mouse_control;
+    int         tile_web_max_fps;
 #endif
 #endif // USE_TILE
 
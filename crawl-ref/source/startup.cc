@@ -154,6 +154,13 @@ static void _initialize()
 
     you.game_seed = crawl_state.seed;
 
+    if (!SysEnv.save_bench.empty())
+    {
+        release_cli_signals();
+        benchmark_save(SysEnv.save_bench, SysEnv.map_gen_iters);
+        end(0, false);
+    }
+
 #ifdef DEBUG_STATISTICS
     if (crawl_state.map_stat_gen)
     {
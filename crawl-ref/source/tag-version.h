@@ -260,6 +260,7 @@ enum tag_minor_version
     TAG_MINOR_COMPRESS_BADMUTS,    // Reduce some mutations to 2 levels
     TAG_MINOR_NEW_TREES,           // New tree types
     TAG_MINOR_DISEASE,             // Turn disease into a normal duration
+    TAG_MINOR_MAP_PLANES,          // Columnar map knowledge, delta forgotten map
 #endif
     NUM_TAG_MINORS,
     TAG_MINOR_VERSION = NUM_TAG_MINORS - 1
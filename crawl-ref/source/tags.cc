@@ -18,6 +18,7 @@
 #include "tags.h"
 
 #include <algorithm>
+#include <chrono>
 #include <cstdio>
 #include <cstdlib>
 #include <cstring>
@@ -1164,35 +1165,89 @@ static void _add_missing_branches()
 #endif
 
 
+tag_profile_data *tag_profile = nullptr;
+
+// Charges the time between consecutive start() calls to the named sections
+// of tag_profile. Does nothing unless profiling is enabled.
+class tag_section_timer
+{
+public:
+    tag_section_timer(bool reading) : m_reading(reading), m_section(nullptr)
+    {
+    }
+
+    ~tag_section_timer()
+    {
+        stop();
+    }
+
+    void start(const char *section)
+    {
+        stop();
+        if (!tag_profile)
+            return;
+        m_section = section;
+        m_start = chrono::steady_clock::now();
+    }
+
+    void stop()
+    {
+        if (!m_section || !tag_profile)
+            return;
+
+        const auto elapsed = chrono::steady_clock::now() - m_start;
+        tag_section_time &t = m_reading ? tag_profile->read[m_section]
+                                        : tag_profile->write[m_section];
+        t.usecs += chrono::duration_cast<chrono::microseconds>(elapsed).count();
+        t.calls++;
+        m_section = nullptr;
+    }
+
+private:
+    bool m_reading;
+    const char *m_section;
+    chrono::steady_clock::time_point m_start;
+};
+
 // Write a tagged chunk of data to the FILE*.
 // tagId specifies what to write.
 void tag_write(tag_type tagID, writer &outf)
 {
     vector<unsigned char> buf;
     writer th(&buf);
+    tag_section_timer timer(false);
     switch (tagID)
     {
     case TAG_CHR:
         _tag_construct_char(th);
         break;
     case TAG_YOU:
+        timer.start("you");
         _tag_construct_you(th);
         CANARY;
+        timer.start("you_items");
         _tag_construct_you_items(th);
         CANARY;
+        timer.start("you_dungeon");
         _tag_construct_you_dungeon(th);
         CANARY;
+        timer.start("lost_monsters");
         _tag_construct_lost_monsters(th);
         CANARY;
+        timer.start("companions");
         _tag_construct_companions(th);
         break;
     case TAG_LEVEL:
+        timer.start("level");
         _tag_construct_level(th);
         CANARY;
+        timer.start("level_items");
         _tag_construct_level_items(th);
         CANARY;
+        timer.start("level_monsters");
         _tag_construct_level_monsters(th);
         CANARY;
+        timer.start("level_tiles");
         _tag_construct_level_tiles(th);
         break;
     case TAG_GHOST:
@@ -1207,6 +1262,8 @@ void tag_write(tag_type tagID, writer &outf)
     if (buf.empty())
         return;
 
+    timer.stop();
+
     // Write tag header.
     marshallInt(outf, buf.size());
 
@@ -1259,15 +1316,20 @@ void tag_read(reader &inf, tag_type tag_id)
 
     // Ok, we have data now.
     reader th(buf, inf.getMinorVersion());
+    tag_section_timer timer(true);
     switch (tag_id)
     {
     case TAG_YOU:
+        timer.start("you");
         _tag_read_you(th);
         EAT_CANARY;
+        timer.start("you_items");
         _tag_read_you_items(th);
         EAT_CANARY;
+        timer.start("you_dungeon");
         _tag_read_you_dungeon(th);
         EAT_CANARY;
+        timer.start("lost_monsters");
         _tag_read_lost_monsters(th);
         EAT_CANARY;
 #if TAG_MAJOR_VERSION == 34
@@ -1278,7 +1340,10 @@ void tag_read(reader &inf, tag_type tag_id)
         }
         if (th.getMinorVersion() >= TAG_MINOR_COMPANION_LIST)
 #endif
-        _tag_read_companions(th);
+        {
+            timer.start("companions");
+            _tag_read_companions(th);
+        }
 
         // If somebody SIGHUP'ed out of the skill menu with every skill
         // disabled. Doing this here rather in _tag_read_you() because
@@ -1286,16 +1351,20 @@ void tag_read(reader &inf, tag_type tag_id)
         init_can_currently_train();
         break;
     case TAG_LEVEL:
+        timer.start("level");
         _tag_read_level(th);
         EAT_CANARY;
+        timer.start("level_items");
         _tag_read_level_items(th);
         // We have to do this here because _tag_read_level_monsters()
         // might kill an elsewhere Ilsuiw follower, which ends up calling
         // terrain.cc:_dgn_check_terrain_items, which checks env.item.
         link_items();
         EAT_CANARY;
+        timer.start("level_monsters");
         _tag_read_level_monsters(th);
         EAT_CANARY;
+        timer.start("level_validate");
 #if TAG_MAJOR_VERSION == 34
         _add_missing_branches();
 #endif
@@ -1309,6 +1378,7 @@ void tag_read(reader &inf, tag_type tag_id)
             unwind_var<coord_def> you_pos(you.position, coord_def());
             check_map_validity();
         }
+        timer.start("level_tiles");
         _tag_read_level_tiles(th);
 #if TAG_MAJOR_VERSION == 34
         if (you.where_are_you == BRANCH_GAUNTLET
@@ -4579,15 +4649,16 @@ static void _tag_construct_level(writer &th)
         for (int count_y = 0; count_y < GYM; count_y++)
         {
             marshallByte(th, env.grid[count_x][count_y]);
-            marshallMapCell(th, env.map_knowledge[count_x][count_y]);
             marshallInt(th, env.pgrid[count_x][count_y].flags);
         }
 
+    marshallMapKnowledge(th, env.map_knowledge);
+
+    // The forgotten map is nearly always a near-copy of the current one, so
+    // only store the cells that differ.
     marshallBoolean(th, !!env.map_forgotten);
     if (env.map_forgotten)
-        for (int x = 0; x < GXM; x++)
-            for (int y = 0; y < GYM; y++)
-                marshallMapCell(th, (*env.map_forgotten)[x][y]);
+        marshallMapDelta(th, *env.map_forgotten, env.map_knowledge);
 
     _run_length_encode(th, marshallByte, env.grid_colours, GXM, GYM);
 
@@ -5334,6 +5405,76 @@ void unmarshallItem(reader &th, item_def &item)
 #define MAP_SERIALIZE_CLOUD 0x20
 #define MAP_SERIALIZE_MONSTER 0x40
 
+static unsigned _map_cell_payload_flags(const map_cell &cell)
+{
+    unsigned flags = 0;
+
+    if (cell.cloud() != CLOUD_NONE)
+        flags |= MAP_SERIALIZE_CLOUD;
+
+    if (cell.item())
+        flags |= MAP_SERIALIZE_ITEM;
+
+    if (cell.monster() != MONS_NO_MONSTER)
+        flags |= MAP_SERIALIZE_MONSTER;
+
+    return flags;
+}
+
+static void _marshall_map_cell_payload(writer &th, const map_cell &cell,
+                                       unsigned flags)
+{
+    if (flags & MAP_SERIALIZE_CLOUD)
+    {
+        cloud_info* ci = cell.cloudinfo();
+        marshallUnsigned(th, ci->type);
+        marshallUnsigned(th, ci->colour);
+        marshallUnsigned(th, ci->duration);
+        marshallShort(th, ci->tile);
+        marshallUByte(th, ci->killer);
+    }
+
+    if (flags & MAP_SERIALIZE_ITEM)
+        marshallItem(th, *cell.item(), true);
+
+    if (flags & MAP_SERIALIZE_MONSTER)
+        _marshallMonsterInfo(th, *cell.monsterinfo());
+}
+
+// Note that this may clobber the cell's item and monster flags; callers
+// should set those afterwards.
+static void _unmarshall_map_cell_payload(reader &th, map_cell &cell,
+                                         unsigned flags)
+{
+    if (flags & MAP_SERIALIZE_CLOUD)
+    {
+        cloud_info ci;
+        ci.type = (cloud_type)unmarshallUnsigned(th);
+        unmarshallUnsigned(th, ci.colour);
+        unmarshallUnsigned(th, ci.duration);
+        ci.tile = unmarshallShort(th);
+#if TAG_MAJOR_VERSION == 34
+        if (th.getMinorVersion() >= TAG_MINOR_CLOUD_OWNER)
+#endif
+        ci.killer = static_cast<killer_type>(unmarshallUByte(th));
+        cell.set_cloud(ci);
+    }
+
+    if (flags & MAP_SERIALIZE_ITEM)
+    {
+        item_def item;
+        unmarshallItem(th, item);
+        cell.set_item(item, false);
+    }
+
+    if (flags & MAP_SERIALIZE_MONSTER)
+    {
+        monster_info mi;
+        _unmarshallMonsterInfo(th, mi);
+        cell.set_monster(mi);
+    }
+}
+
 void marshallMapCell(writer &th, const map_cell &cell)
 {
     unsigned flags = 0;
@@ -5351,14 +5492,7 @@ void marshallMapCell(writer &th, const map_cell &cell)
     if (cell.feat_colour())
         flags |= MAP_SERIALIZE_FEATURE_COLOUR;
 
-    if (cell.cloud() != CLOUD_NONE)
-        flags |= MAP_SERIALIZE_CLOUD;
-
-    if (cell.item())
-        flags |= MAP_SERIALIZE_ITEM;
-
-    if (cell.monster() != MONS_NO_MONSTER)
-        flags |= MAP_SERIALIZE_MONSTER;
+    flags |= _map_cell_payload_flags(cell);
 
     marshallUnsigned(th, flags);
 
@@ -5388,21 +5522,7 @@ void marshallMapCell(writer &th, const map_cell &cell)
     if (feat_is_trap(cell.feat()))
         marshallByte(th, cell.trap());
 
-    if (flags & MAP_SERIALIZE_CLOUD)
-    {
-        cloud_info* ci = cell.cloudinfo();
-        marshallUnsigned(th, ci->type);
-        marshallUnsigned(th, ci->colour);
-        marshallUnsigned(th, ci->duration);
-        marshallShort(th, ci->tile);
-        marshallUByte(th, ci->killer);
-    }
-
-    if (flags & MAP_SERIALIZE_ITEM)
-        marshallItem(th, *cell.item(), true);
-
-    if (flags & MAP_SERIALIZE_MONSTER)
-        _marshallMonsterInfo(th, *cell.monsterinfo());
+    _marshall_map_cell_payload(th, cell, flags);
 }
 
 void unmarshallMapCell(reader &th, map_cell& cell)
@@ -5456,36 +5576,160 @@ void unmarshallMapCell(reader &th, map_cell& cell)
 
     cell.set_feature(feature, feat_colour, trap);
 
-    if (flags & MAP_SERIALIZE_CLOUD)
-    {
-        cloud_info ci;
-        ci.type = (cloud_type)unmarshallUnsigned(th);
-        unmarshallUnsigned(th, ci.colour);
-        unmarshallUnsigned(th, ci.duration);
-        ci.tile = unmarshallShort(th);
+    _unmarshall_map_cell_payload(th, cell, flags);
+
+    // set this last so the other sets don't override this
+    cell.flags = cell_flags;
+}
+
+// Does this cell agree with another on everything except its cloud, item
+// and monster?
+static bool _same_map_terrain(const map_cell &a, const map_cell &b)
+{
+    return a.flags == b.flags
+           && a.feat() == b.feat()
+           && a.feat_colour() == b.feat_colour()
+           && (!feat_is_trap(a.feat()) || a.trap() == b.trap());
+}
+
+static void _marshall_map_terrain(writer &th, const map_cell &cell)
+{
+    marshallUnsigned(th, cell.flags);
 #if TAG_MAJOR_VERSION == 34
-        if (th.getMinorVersion() >= TAG_MINOR_CLOUD_OWNER)
+    marshallUnsigned(th, cell.feat());
+#else
+    marshallUByte(th, cell.feat());
 #endif
-        ci.killer = static_cast<killer_type>(unmarshallUByte(th));
-        cell.set_cloud(ci);
+    marshallUnsigned(th, cell.feat_colour());
+    if (feat_is_trap(cell.feat()))
+        marshallByte(th, cell.trap());
+}
+
+static void _unmarshall_map_terrain(reader &th, map_cell &cell)
+{
+    const uint32_t cell_flags = unmarshallUnsigned(th);
+#if TAG_MAJOR_VERSION == 34
+    const dungeon_feature_type feature = unmarshallFeatureType_Info(th);
+#else
+    const dungeon_feature_type feature = unmarshallFeatureType(th);
+#endif
+    const unsigned feat_colour = unmarshallUnsigned(th);
+    trap_type trap = TRAP_UNASSIGNED;
+    if (feat_is_trap(feature))
+        trap = (trap_type)unmarshallByte(th);
+
+    cell.set_feature(feature, feat_colour, trap);
+    cell.flags = cell_flags;
+}
+
+static coord_def _map_cell_index_pos(int i)
+{
+    return coord_def(i / GYM, i % GYM);
+}
+
+/**
+ * Write a whole MapKnowledge grid in columnar form.
+ *
+ * Most of a mapped level is long runs of identical wall and floor knowledge,
+ * so the flags, feature and colour are run-length encoded (in the same x-major
+ * order as the level grids). Clouds, items and monsters are rare and follow
+ * in a separate table keyed by position.
+ */
+void marshallMapKnowledge(writer &th, const MapKnowledge &map)
+{
+    const int ncells = GXM * GYM;
+    for (int i = 0; i < ncells;)
+    {
+        const map_cell &cell = map(_map_cell_index_pos(i));
+        int run = 1;
+        while (i + run < ncells
+               && _same_map_terrain(cell, map(_map_cell_index_pos(i + run))))
+        {
+            ++run;
+        }
+
+        marshallUnsigned(th, run);
+        _marshall_map_terrain(th, cell);
+        i += run;
     }
 
-    if (flags & MAP_SERIALIZE_ITEM)
+    vector<coord_def> payload_cells;
+    for (int i = 0; i < ncells; ++i)
+        if (_map_cell_payload_flags(map(_map_cell_index_pos(i))))
+            payload_cells.push_back(_map_cell_index_pos(i));
+
+    marshallInt(th, payload_cells.size());
+    for (const coord_def &c : payload_cells)
     {
-        item_def item;
-        unmarshallItem(th, item);
-        cell.set_item(item, false);
+        const unsigned flags = _map_cell_payload_flags(map(c));
+        marshallCoord(th, c);
+        marshallUnsigned(th, flags);
+        _marshall_map_cell_payload(th, map(c), flags);
     }
+}
 
-    if (flags & MAP_SERIALIZE_MONSTER)
+void unmarshallMapKnowledge(reader &th, MapKnowledge &map)
+{
+    const int ncells = GXM * GYM;
+    for (int i = 0; i < ncells;)
     {
-        monster_info mi;
-        _unmarshallMonsterInfo(th, mi);
-        cell.set_monster(mi);
+        const int run = unmarshallUnsigned(th);
+        ASSERT(run > 0 && i + run <= ncells);
+
+        map_cell cell;
+        _unmarshall_map_terrain(th, cell);
+        for (const int end = i + run; i < end; ++i)
+            map(_map_cell_index_pos(i)) = cell;
     }
 
-    // set this last so the other sets don't override this
-    cell.flags = cell_flags;
+    const int npayload = unmarshallInt(th);
+    for (int i = 0; i < npayload; ++i)
+    {
+        const coord_def c = unmarshallCoord(th);
+        ASSERT(map_bounds(c));
+        map_cell &cell = map(c);
+        const uint32_t cell_flags = cell.flags;
+        _unmarshall_map_cell_payload(th, cell, unmarshallUnsigned(th));
+        cell.flags = cell_flags;
+    }
+}
+
+/**
+ * Write only the cells of a MapKnowledge grid that differ from a base grid.
+ * The reader is expected to start from a copy of the base.
+ */
+void marshallMapDelta(writer &th, const MapKnowledge &map,
+                      const MapKnowledge &base)
+{
+    vector<coord_def> changed;
+    for (rectangle_iterator ri(0); ri; ++ri)
+    {
+        const map_cell &cell = map(*ri);
+        const map_cell &old = base(*ri);
+        if (!_same_map_terrain(cell, old)
+            || _map_cell_payload_flags(cell) || _map_cell_payload_flags(old))
+        {
+            changed.push_back(*ri);
+        }
+    }
+
+    marshallInt(th, changed.size());
+    for (const coord_def &c : changed)
+    {
+        marshallCoord(th, c);
+        marshallMapCell(th, map(c));
+    }
+}
+
+void unmarshallMapDelta(reader &th, MapKnowledge &map)
+{
+    const int nchanged = unmarshallInt(th);
+    for (int i = 0; i < nchanged; ++i)
+    {
+        const coord_def c = unmarshallCoord(th);
+        ASSERT(map_bounds(c));
+        unmarshallMapCell(th, map(c));
+    }
 }
 
 static void _tag_construct_level_items(writer &th)
@@ -6103,22 +6347,20 @@ static void _tag_read_level(reader &th)
             // Save these for potential destination clean up.
             if (env.grid[i][j] == DNGN_TRANSPORTER)
                 transporters.push_back(coord_def(i, j));
-#endif
-            unmarshallMapCell(th, env.map_knowledge[i][j]);
-            // Fixup positions
-            if (env.map_knowledge[i][j].monsterinfo())
-                env.map_knowledge[i][j].monsterinfo()->pos = coord_def(i, j);
-            if (env.map_knowledge[i][j].cloudinfo())
-                env.map_knowledge[i][j].cloudinfo()->pos = coord_def(i, j);
 
-            env.map_knowledge[i][j].flags &= ~MAP_VISIBLE_FLAG;
-            if (env.map_knowledge[i][j].seen())
-                env.map_seen.set(i, j);
+            if (th.getMinorVersion() < TAG_MINOR_MAP_PLANES)
+                unmarshallMapCell(th, env.map_knowledge[i][j]);
+#endif
             env.pgrid[i][j].flags = unmarshallInt(th);
 
             env.mgrid[i][j] = NON_MONSTER;
         }
 
+#if TAG_MAJOR_VERSION == 34
+    if (th.getMinorVersion() >= TAG_MINOR_MAP_PLANES)
+#endif
+    unmarshallMapKnowledge(th, env.map_knowledge);
+
 #if TAG_MAJOR_VERSION == 34
     if (th.getMinorVersion() < TAG_MINOR_FORGOTTEN_MAP)
         env.map_forgotten.reset();
@@ -6127,14 +6369,40 @@ static void _tag_read_level(reader &th)
     if (unmarshallBoolean(th))
     {
         MapKnowledge *f = new MapKnowledge();
-        for (int x = 0; x < GXM; x++)
-            for (int y = 0; y < GYM; y++)
-                unmarshallMapCell(th, (*f)[x][y]);
+#if TAG_MAJOR_VERSION == 34
+        if (th.getMinorVersion() < TAG_MINOR_MAP_PLANES)
+        {
+            for (int x = 0; x < GXM; x++)
+                for (int y = 0; y < GYM; y++)
+                    unmarshallMapCell(th, (*f)[x][y]);
+        }
+        else
+#endif
+        {
+            // Stored as a delta against the current map, so this must be
+            // read before the current map is fixed up below.
+            *f = env.map_knowledge;
+            unmarshallMapDelta(th, *f);
+        }
         env.map_forgotten.reset(f);
     }
     else
         env.map_forgotten.reset();
 
+    for (rectangle_iterator ri(0); ri; ++ri)
+    {
+        map_cell &cell = env.map_knowledge(*ri);
+        // Fixup positions
+        if (cell.monsterinfo())
+            cell.monsterinfo()->pos = *ri;
+        if (cell.cloudinfo())
+            cell.cloudinfo()->pos = *ri;
+
+        cell.flags &= ~MAP_VISIBLE_FLAG;
+        if (cell.seen())
+            env.map_seen.set(*ri);
+    }
+
     env.grid_colours.init(BLACK);
     _run_length_decode(th, unmarshallByte, env.grid_colours, GXM, GYM);
 
@@ -13,6 +13,7 @@
 #include "debug.h"
 #include "defines.h"
 #include "dungeon-feature-type.h"
+#include "fixedarray.h"
 #include "fixedvector.h"
 #include "level-id.h"
 #include "package.h"
@@ -182,6 +183,12 @@ static inline void unmarshallSigned(reader& th, T& v)
 void marshallMapCell (writer &, const map_cell &);
 void unmarshallMapCell (reader &, map_cell& cell);
 
+void marshallMapKnowledge(writer &, const FixedArray<map_cell, GXM, GYM> &);
+void unmarshallMapKnowledge(reader &, FixedArray<map_cell, GXM, GYM> &);
+void marshallMapDelta(writer &, const FixedArray<map_cell, GXM, GYM> &map,
+                      const FixedArray<map_cell, GXM, GYM> &base);
+void unmarshallMapDelta(reader &, FixedArray<map_cell, GXM, GYM> &map);
+
 FixedVector<spell_type, MAX_KNOWN_SPELLS> unmarshall_player_spells(reader &th);
 
 void unmarshallSpells(reader &, monster_spells &
@@ -208,6 +215,24 @@ void tag_read_char(reader &th, uint8_t format, uint8_t major, uint8_t minor);
 vector<ghost_demon> tag_read_ghosts(reader &th);
 void tag_write_ghosts(writer &th, const vector<ghost_demon> &ghosts);
 
+struct tag_section_time
+{
+    tag_section_time() : usecs(0), calls(0) { }
+
+    uint64_t usecs;
+    int calls;
+};
+
+// Wall time spent in each section of tag_read() and tag_write(), keyed by
+// section name ("level_items" etc). Only collected while tag_profile is set.
+struct tag_profile_data
+{
+    map<string, tag_section_time> read;
+    map<string, tag_section_time> write;
+};
+
+extern tag_profile_data *tag_profile;
+
 /* ***********************************************************************
  * misc
  * *********************************************************************** */
@@ -91,19 +91,122 @@ void WebTextArea::put_character(char32_t chr, int fg, int bg, int x, int y)
     m_abuf[x + y * mx] = col;
 }
 
+static uint32_t _row_hash(const char32_t *cbuf, const uint8_t *abuf, int len)
+{
+    uint32_t hash = 2166136261U;
+    for (int i = 0; i < len; ++i)
+    {
+        hash = (hash ^ (uint32_t) cbuf[i]) * 16777619U;
+        hash = (hash ^ abuf[i]) * 16777619U;
+    }
+    return hash;
+}
+
+static bool _row_is_blank(const char32_t *cbuf, const uint8_t *abuf, int len)
+{
+    for (int i = 0; i < len; ++i)
+        if (cbuf[i] != ' ' || abuf[i] != 0)
+            return false;
+    return true;
+}
+
+/**
+ * Look for a vertical scroll between what the client has and what it
+ * should show.
+ *
+ * @return the shift that leaves the fewest rows to resend, where row y
+ *         takes the contents of row y + shift and rows shifted in from
+ *         outside are blank; or 0 if no shift beats resending in place.
+ */
+int WebTextArea::_find_scroll() const
+{
+    vector<uint32_t> old_hash(my), new_hash(my);
+    vector<bool> new_blank(my);
+    for (int y = 0; y < my; ++y)
+    {
+        old_hash[y] = _row_hash(m_old_cbuf + y * mx, m_old_abuf + y * mx, mx);
+        new_hash[y] = _row_hash(m_cbuf + y * mx, m_abuf + y * mx, mx);
+        new_blank[y] = _row_is_blank(m_cbuf + y * mx, m_abuf + y * mx, mx);
+    }
+
+    // Hashes only pick candidates; matching rows are compared in full.
+    auto row_matches = [&](int y, int old_y)
+    {
+        if (old_y < 0 || old_y >= my)
+            return (bool) new_blank[y];
+        return new_hash[y] == old_hash[old_y]
+               && !memcmp(m_cbuf + y * mx, m_old_cbuf + old_y * mx,
+                          mx * sizeof(char32_t))
+               && !memcmp(m_abuf + y * mx, m_old_abuf + old_y * mx, mx);
+    };
+
+    int best_shift = 0;
+    int best_cost = 0;
+    for (int y = 0; y < my; ++y)
+        if (!row_matches(y, y))
+            best_cost++;
+
+    for (int shift = 1 - my; shift < my && best_cost > 0; ++shift)
+    {
+        if (!shift)
+            continue;
+        int cost = 0;
+        for (int y = 0; y < my && cost < best_cost; ++y)
+            if (!row_matches(y, y + shift))
+                cost++;
+        if (cost < best_cost)
+        {
+            best_shift = shift;
+            best_cost = cost;
+        }
+    }
+    return best_shift;
+}
+
+// Does to the copy of the client's contents what a "shift" op does on the
+// client.
+void WebTextArea::_scroll_old_rows(int shift)
+{
+    const int kept = my - abs(shift);
+    const int from = shift > 0 ? shift : 0;
+    const int to = shift > 0 ? 0 : -shift;
+    memmove(m_old_cbuf + to * mx, m_old_cbuf + from * mx,
+            kept * mx * sizeof(char32_t));
+    memmove(m_old_abuf + to * mx, m_old_abuf + from * mx, kept * mx);
+
+    const int blank_start = shift > 0 ? kept : 0;
+    for (int i = blank_start * mx; i < (blank_start + abs(shift)) * mx; ++i)
+    {
+        m_old_cbuf[i] = ' ';
+        m_old_abuf[i] = 0;
+    }
+}
+
 void WebTextArea::send(bool force)
 {
     if (m_cbuf == nullptr) return;
     if (!force && !m_dirty) return;
     m_dirty = false;
 
+    bool sending = false;
+
+    // When a page scrolls, move the rows the client already has instead of
+    // sending them again.
+    const int shift = force ? 0 : _find_scroll();
+    if (shift)
+    {
+        _scroll_old_rows(shift);
+        tiles.write_message("{\"msg\":\"txt\",\"id\":\"%s\""
+                            ",\"shift\":%d,\"rows\":%d,\"lines\":{",
+                            m_client_side_name.c_str(), shift, my);
+        sending = true;
+    }
+
     int last_col = -1;
     int space_count = 0;
     bool dirty = false;
     string html;
 
-    bool sending = false;
-
     for (int y = 0; y < my; ++y)
     {
         last_col = -1;
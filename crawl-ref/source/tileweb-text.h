@@ -30,6 +30,9 @@ protected:
 
     bool m_dirty;
 
+    int _find_scroll() const;
+    void _scroll_old_rows(int shift);
+
     virtual void on_resize();
 };
 
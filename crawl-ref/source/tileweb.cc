@@ -8,6 +8,7 @@
 #include <cstdarg>
 
 #include <sys/socket.h>
+#include <sys/stat.h>
 #include <sys/time.h>
 #include <sys/types.h>
 #include <sys/un.h>
@@ -20,6 +21,7 @@
 #include "command.h"
 #include "coord.h"
 #include "database.h"
+#include "delay.h"
 #include "directn.h"
 #include "english.h"
 #include "env.h"
@@ -44,6 +46,7 @@
 #include "skills.h"
 #include "state.h"
 #include "stringutil.h"
+#include "syscalls.h"
 #include "throw.h"
 #include "tile-flags.h"
 #include "tile-player-flag-cut.h"
@@ -66,6 +69,28 @@
 
 //#define DEBUG_WEBSOCKETS
 
+// How far a receiver may fall behind before its queued output is dropped in
+// favour of a full resync.
+static const size_t MAX_PENDING_BYTES = 2 * 1024 * 1024;
+// How long shutdown() waits for receivers to take the rest of their queues.
+static const unsigned int EXIT_DRAIN_MS = 5000;
+
+// A resync (_send_everything) rebuilds the map, player and UI state, but not
+// messages for the server (starred), nor the message window: only unsent
+// lines go out, so lines dropped from a queue would be gone for good. Those must
+// always reach a receiver, however far behind it is.
+static bool _resync_cannot_rebuild(const string &msg)
+{
+    static const char msgs_prefix[] = "{\"msg\":\"msgs\"";
+    return msg[0] == '*'
+           || !msg.compare(0, sizeof(msgs_prefix) - 1, msgs_prefix);
+}
+
+#ifdef TARGET_OS_LINUX
+// Most datagrams to pass to one sendmmsg() call.
+static const int SEND_BATCH_SIZE = 64;
+#endif
+
 static unsigned int get_milliseconds()
 {
     // This is Unix-only, but so is Webtiles at the moment.
@@ -78,9 +103,18 @@ static unsigned int get_milliseconds()
 TilesFramework tiles;
 
 TilesFramework::TilesFramework() :
+      m_need_resync(false),
+      m_coalesced_bytes(0),
+      m_coalesce_count(0),
+      m_stats_turn(0),
+      m_last_stats_turn(-1),
+      m_record(nullptr),
+      m_record_turn(-1),
+      m_next_keyframe_turn(0),
       m_controlled_from_web(false),
       _send_lock(false),
       m_last_ui_state(UI_INIT),
+      m_frame_deferred(false),
       m_view_loaded(false),
       m_current_view(coord_def(GXM, GYM)),
       m_next_view(coord_def(GXM, GYM)),
@@ -107,6 +141,8 @@ void TilesFramework::shutdown()
     if (m_sock_name.empty())
         return;
 
+    _drain_before_exit();
+    _close_recording();
     close(m_sock);
     remove(m_sock_name.c_str());
 }
@@ -149,6 +185,8 @@ bool TilesFramework::initialise()
     if (setsockopt(m_sock, SOL_SOCKET, SO_SNDTIMEO, &tv, sizeof(tv)) < 0)
         die("Can't set send timeout!");
 
+    _open_recording();
+
     if (m_await_connection)
         _await_connection();
 
@@ -165,20 +203,67 @@ string TilesFramework::get_message()
     return m_msg_buf;
 }
 
-void TilesFramework::write_message(const char *format, ...)
+// Appends printf-style output to buf. Most messages fit the stack buffer;
+// longer ones are formatted a second time straight into buf.
+static void _append_vformat(string &buf, const char *format, va_list argp)
+{
+    char stack_buf[2048];
+
+    va_list argp2;
+    va_copy(argp2, argp);
+    const int len = vsnprintf(stack_buf, sizeof(stack_buf), format, argp);
+    if (len < 0)
+        die("Webtiles message format error! (%s)", format);
+    else if (len < (int)sizeof(stack_buf))
+        buf.append(stack_buf, len);
+    else
+    {
+        const size_t start = buf.size();
+        buf.resize(start + len + 1);
+        vsnprintf(&buf[start], len + 1, format, argp2);
+        buf.resize(start + len);
+    }
+    va_end(argp2);
+}
+
+// Formats value in decimal at the end of buf, without going through printf,
+// and returns where the number starts.
+static const char *_format_int(char (&buf)[12], int value)
+{
+    char *p = buf + sizeof(buf) - 1;
+    *p = '\0';
+    unsigned int n = value < 0 ? 0U - (unsigned int) value : value;
+    do
+    {
+        *--p = '0' + n % 10;
+        n /= 10;
+    }
+    while (n);
+    if (value < 0)
+        *--p = '-';
+    return p;
+}
+
+static void _append_int(string &buf, int value)
 {
-    char buf[2048];
-    int len;
+    char digits[12];
+    const char *p = _format_int(digits, value);
+    buf.append(p, digits + sizeof(digits) - 1 - p);
+}
 
+void TilesFramework::_start_message()
+{
+    if (m_msg_buf.empty())
+        m_msg_start = chrono::steady_clock::now();
+}
+
+void TilesFramework::write_message(const char *format, ...)
+{
+    _start_message();
     va_list argp;
     va_start(argp, format);
-    if ((len = vsnprintf(buf, sizeof(buf), format, argp)) < 0)
-        die("Webtiles message format error! (%s)", format);
-    else if (len >= (int)sizeof(buf))
-        die("Webtiles message too long! (%d)", len);
+    _append_vformat(m_msg_buf, format, argp);
     va_end(argp);
-
-    m_msg_buf.append(buf);
 }
 
 void TilesFramework::finish_message()
@@ -196,117 +281,435 @@ void TilesFramework::finish_message()
         return;
     }
 
+    _account_message();
     m_msg_buf.append("\n");
-    const char* fragment_start = m_msg_buf.data();
-    const char* data_end = m_msg_buf.data() + m_msg_buf.size();
-    int fragments = 0;
-    while (fragment_start < data_end)
+
+    // Messages for the server (starred) are not part of what is watched.
+    if (m_record && m_msg_buf[0] != '*')
+        _record_message();
+
+    // Receivers that cannot take all of this right now queue it, sharing
+    // one copy; nobody waits for them.
+    const bool must_deliver = _resync_cannot_rebuild(m_msg_buf);
+    shared_ptr<const string> queued;
+    for (unsigned int i = 0; i < m_dests.size(); ++i)
     {
-        int fragment_size = data_end - fragment_start;
-        if (fragment_size > m_max_msg_size)
-            fragment_size = m_max_msg_size;
-        fragments++;
+        MessageDest &dest = m_dests[i];
+        if (dest.resync && !must_deliver)
+        {
+            // It will get everything again once it catches up.
+            m_coalesced_bytes += m_msg_buf.size();
+            continue;
+        }
 
-        for (unsigned int i = 0; i < m_dest_addrs.size(); ++i)
+        size_t sent = 0;
+        send_result result = _drain_dest(dest);
+        if (result == SEND_DONE)
+            result = _send_datagrams(dest.addr, m_msg_buf, sent);
+
+        if (result == SEND_CLOSED)
         {
-            int retries = 30;
-            ssize_t sent = 0;
-            while (sent < fragment_size)
-            {
-                ssize_t retval = sendto(m_sock, fragment_start + sent,
-                    fragment_size - sent, 0, (sockaddr*) &m_dest_addrs[i],
-                    sizeof(sockaddr_un));
+            m_dests.erase(m_dests.begin() + i);
+            i--;
+            continue;
+        }
+
+        if (sent < m_msg_buf.size())
+        {
+            if (!queued)
+                queued = make_shared<const string>(m_msg_buf);
+            if (dest.pending.empty())
+                dest.pending_offset = sent;
+            dest.pending.push_back(queued);
+            dest.pending_bytes += m_msg_buf.size() - sent;
+            if (dest.pending_bytes > MAX_PENDING_BYTES && !dest.resync)
+                _coalesce_backlog(dest);
+        }
+    }
+    m_msg_buf.clear();
+    m_need_flush = true;
 #ifdef DEBUG_WEBSOCKETS
-                fprintf(stderr,
-                            "    trying to send fragment to client %d...", i);
+    // should the game actually crash in this case?
+    if (m_controlled_from_web && m_dests.size() == 0)
+        fprintf(stderr, "No open websockets after finish_message!!\n");
+
+    fprintf(stderr, "websocket: Sent %d bytes.\n", initial_buf_size);
 #endif
-                if (retval <= 0)
-                {
-                    const char *errmsg = retval == 0 ? "No bytes sent"
-                                                     : strerror(errno);
-                    if (--retries <= 0)
-                        die("Socket write error: %s", errmsg);
+}
 
-                    if (retval == 0 || errno == ENOBUFS || errno == EWOULDBLOCK
-                        || errno == EINTR || errno == EAGAIN)
-                    {
-                        // Wait for half a second at first (up to five), then
-                        // try again.
-                        const int sleep_time = retries > 25 ? 2 * 1000
-                                             : retries > 10 ? 500 * 1000
-                                             : 5000 * 1000;
-#ifdef DEBUG_WEBSOCKETS
-                        fprintf(stderr, "failed (%s), sleeping for %dms.\n",
-                                                    errmsg, sleep_time / 1000);
+// Every message opens with its "msg" field; anything else is "other".
+void TilesFramework::_account_message()
+{
+    static const char prefix[] = "{\"msg\":\"";
+    const char *type = "other";
+    size_t len = 5;
+    const size_t at = m_msg_buf[0] == '*' ? 1 : 0;
+    if (!m_msg_buf.compare(at, sizeof(prefix) - 1, prefix))
+    {
+        const size_t start = at + sizeof(prefix) - 1;
+        const size_t end = m_msg_buf.find('"', start);
+        if (end != string::npos)
+        {
+            type = m_msg_buf.data() + start;
+            len = end - start;
+        }
+    }
+
+    const uint64_t usecs = chrono::duration_cast<chrono::microseconds>(
+                               chrono::steady_clock::now() - m_msg_start)
+                           .count();
+    if (you.num_turns != m_stats_turn)
+    {
+        m_last_turn_stats = m_turn_stats;
+        m_last_stats_turn = m_stats_turn;
+        for (MessageStats &stats : m_turn_stats)
+            stats.count = stats.bytes = stats.usecs = 0;
+        m_stats_turn = you.num_turns;
+    }
+    // Count the terminating newline too.
+    _add_message_stats(m_session_stats, type, len, m_msg_buf.size() + 1,
+                       usecs);
+    _add_message_stats(m_turn_stats, type, len, m_msg_buf.size() + 1, usecs);
+}
+
+void TilesFramework::_add_message_stats(vector<MessageStats> &stats,
+                                        const char *type, size_t len,
+                                        size_t bytes, uint64_t usecs)
+{
+    // There are only a few dozen types, so a linear search is fine.
+    auto it = find_if(stats.begin(), stats.end(),
+                      [=](const MessageStats &s)
+                      { return !s.type.compare(0, string::npos, type, len); });
+    if (it == stats.end())
+    {
+        stats.emplace_back(type, len);
+        it = stats.end() - 1;
+    }
+    it->count++;
+    it->bytes += bytes;
+    it->usecs += usecs;
+}
+
+void TilesFramework::_write_message_stats(const char *name,
+                                          const vector<MessageStats> &stats)
+{
+    write_message(",\"%s\":{", name);
+    bool first = true;
+    for (const MessageStats &s : stats)
+    {
+        if (!s.count)
+            continue;
+        write_message("%s\"", first ? "" : ",");
+        write_message_escaped(s.type);
+        write_message("\":{\"count\":%u,\"bytes\":%llu,\"usecs\":%llu}",
+                      s.count, (unsigned long long) s.bytes,
+                      (unsigned long long) s.usecs);
+        first = false;
+    }
+    write_message("}");
+}
+
+// Reports the message accounting to the server (hence the star), which
+// logs it.
+void TilesFramework::_send_message_stats()
+{
+    if (m_sock_name.empty() || !m_json_stack.empty() || !m_msg_buf.empty())
+        return;
+
+    write_message("*");
+    write_message("{\"msg\":\"msg_stats\",\"turn\":%d", you.num_turns);
+    _write_message_stats("session", m_session_stats);
+    write_message(",\"last_turn\":%d", m_last_stats_turn);
+    _write_message_stats("last_turn_stats", m_last_turn_stats);
+    write_message(",\"coalesced_bytes\":%llu}",
+                  (unsigned long long) m_coalesced_bytes);
+    finish_message();
+}
+
+// Sends data[sent..] to addr in datagrams of at most m_max_msg_size bytes,
+// for as long as the receiver will take them without blocking. sent is
+// updated with how far it got.
+TilesFramework::send_result
+TilesFramework::_send_datagrams(const sockaddr_un &addr, const string &data,
+                                size_t &sent)
+{
+    while (sent < data.size())
+    {
+#ifdef TARGET_OS_LINUX
+        // Big messages (a full map, say) run to dozens of datagrams; hand
+        // the kernel a batch of them per call.
+        mmsghdr msgs[SEND_BATCH_SIZE];
+        iovec iov[SEND_BATCH_SIZE];
+        int batch = 0;
+        for (size_t pos = sent; pos < data.size() && batch < SEND_BATCH_SIZE;
+             ++batch)
+        {
+            const size_t fragment_size = min(data.size() - pos,
+                                             (size_t) m_max_msg_size);
+            iov[batch].iov_base = const_cast<char *>(data.data() + pos);
+            iov[batch].iov_len = fragment_size;
+            msgs[batch] = mmsghdr();
+            msgs[batch].msg_hdr.msg_name = const_cast<sockaddr_un *>(&addr);
+            msgs[batch].msg_hdr.msg_namelen = sizeof(sockaddr_un);
+            msgs[batch].msg_hdr.msg_iov = &iov[batch];
+            msgs[batch].msg_hdr.msg_iovlen = 1;
+            pos += fragment_size;
+        }
+
+        const int retval = sendmmsg(m_sock, msgs, batch, MSG_DONTWAIT);
+        if (retval > 0)
+        {
+            for (int i = 0; i < retval; ++i)
+                sent += msgs[i].msg_len;
+            continue;
+        }
+#else
+        const size_t fragment_size = min(data.size() - sent,
+                                         (size_t) m_max_msg_size);
+        const ssize_t retval = sendto(m_sock, data.data() + sent,
+                                      fragment_size, MSG_DONTWAIT,
+                                      (const sockaddr*) &addr,
+                                      sizeof(sockaddr_un));
+        if (retval > 0)
+        {
+            sent += retval;
+            continue;
+        }
 #endif
-                        usleep(sleep_time);
-                    }
-                    else if (errno == ECONNREFUSED || errno == ENOENT)
-                    {
-                        // the other side is dead
+
+        if (retval < 0 && errno == EINTR)
+            continue;
+        if (retval == 0 || errno == ENOBUFS || errno == EWOULDBLOCK
+            || errno == EAGAIN)
+        {
 #ifdef DEBUG_WEBSOCKETS
-                        fprintf(stderr,
-                            "failed (%s), breaking.\n", errmsg);
+            fprintf(stderr, "websocket: receiver blocked with %u bytes "
+                            "left to send.\n", (unsigned int) (data.size() - sent));
 #endif
-                        m_dest_addrs.erase(m_dest_addrs.begin() + i);
-                        i--;
-                        break;
-                    }
-                    else
-                        die("Socket write error: %s", errmsg);
-                }
-                else
-                {
+            return SEND_BLOCKED;
+        }
+        if (errno == ECONNREFUSED || errno == ENOENT)
+        {
+            // the other side is dead
 #ifdef DEBUG_WEBSOCKETS
-                    fprintf(stderr, "fragment size %d sent.\n", fragment_size);
+            fprintf(stderr, "websocket: receiver gone (%s).\n",
+                            strerror(errno));
 #endif
-                    sent += retval;
-                }
-            }
+            return SEND_CLOSED;
         }
+        die("Socket write error: %s", strerror(errno));
+    }
+    return SEND_DONE;
+}
 
-        fragment_start += fragment_size;
+TilesFramework::send_result TilesFramework::_drain_dest(MessageDest &dest)
+{
+    while (!dest.pending.empty())
+    {
+        size_t sent = dest.pending_offset;
+        const send_result result =
+            _send_datagrams(dest.addr, *dest.pending.front(), sent);
+        dest.pending_bytes -= sent - dest.pending_offset;
+        dest.pending_offset = sent;
+        if (result != SEND_DONE)
+            return result;
+
+        dest.pending.pop_front();
+        dest.pending_offset = 0;
     }
-    m_msg_buf.clear();
-    m_need_flush = true;
-#ifdef DEBUG_WEBSOCKETS
-    // should the game actually crash in this case?
-    if (m_controlled_from_web && m_dest_addrs.size() == 0)
-        fprintf(stderr, "No open websockets after finish_message!!\n");
 
-    fprintf(stderr, "websocket: Sent %d bytes in %d fragments.\n",
-                                                initial_buf_size, fragments);
-#endif
+    if (dest.resync)
+    {
+        dest.resync = false;
+        m_need_resync = true;
+    }
+    return SEND_DONE;
 }
 
-void TilesFramework::send_message(const char *format, ...)
+// Gives receivers a few seconds to take what is still queued for them, so
+// the final screens and the exit reason are not lost when we exit.
+void TilesFramework::_drain_before_exit()
+{
+    const unsigned int start = get_milliseconds();
+    while (true)
+    {
+        _drain_all_dests();
+        if (!_has_pending_output())
+            return;
+
+        const unsigned int waited = get_milliseconds() - start;
+        if (waited >= EXIT_DRAIN_MS)
+        {
+            fprintf(stderr, "webtiles: receivers still behind at exit, "
+                            "dropping their queued output\n");
+            return;
+        }
+
+        // Datagram sockets can report writable while the receiving end is
+        // still full, so never retry more often than every 10ms.
+        const unsigned int wait = min(EXIT_DRAIN_MS - waited, 10U);
+        fd_set fds;
+        FD_ZERO(&fds);
+        FD_SET(m_sock, &fds);
+        timeval timeout;
+        timeout.tv_sec = 0;
+        timeout.tv_usec = wait * 1000;
+        if (select(m_sock + 1, nullptr, &fds, nullptr, &timeout) > 0)
+            usleep(wait * 1000);
+    }
+}
+
+void TilesFramework::_drain_all_dests()
+{
+    for (unsigned int i = 0; i < m_dests.size(); ++i)
+    {
+        if (_drain_dest(m_dests[i]) == SEND_CLOSED)
+        {
+            m_dests.erase(m_dests.begin() + i);
+            i--;
+        }
+    }
+}
+
+// Throws away every message a lagging receiver has not started on yet and
+// that a resync can rebuild. Rather than catching up on stale deltas, it
+// is sent the whole state afresh (by _send_everything) once it has taken
+// the rest.
+void TilesFramework::_coalesce_backlog(MessageDest &dest)
 {
-    char buf[2048];
-    int len;
+    // Keep a message it already has the start of, or the rest of that would
+    // run into whatever it is sent next.
+    const auto keep = dest.pending.begin() + (dest.pending_offset ? 1 : 0);
+    size_t dropped = 0;
+    const auto kept_end = remove_if(keep, dest.pending.end(),
+        [&dropped](const shared_ptr<const string> &msg)
+        {
+            if (_resync_cannot_rebuild(*msg))
+                return false;
+            dropped += msg->size();
+            return true;
+        });
+    if (!dropped)
+        return;
+    dest.pending.erase(kept_end, dest.pending.end());
+    dest.pending_bytes -= dropped;
+    dest.resync = true;
 
+    m_coalesced_bytes += dropped;
+    m_coalesce_count++;
+    fprintf(stderr, "webtiles: receiver %s fell behind, dropped %u bytes "
+                    "(%d times, %llu bytes in total)\n",
+            dest.addr.sun_path, (unsigned int) dropped, m_coalesce_count,
+            (unsigned long long) m_coalesced_bytes);
+}
+
+bool TilesFramework::_has_pending_output() const
+{
+    for (const MessageDest &dest : m_dests)
+        if (!dest.pending.empty())
+            return true;
+    return false;
+}
+
+void TilesFramework::send_message(const char *format, ...)
+{
+    _start_message();
     va_list argp;
     va_start(argp, format);
-    if ((len = vsnprintf(buf, sizeof(buf), format, argp)) >= (int)sizeof(buf)
-        || len == -1)
+    _append_vformat(m_msg_buf, format, argp);
+    va_end(argp);
+
+    finish_message();
+}
+
+// A recording is a series of gzip members, each starting with a full
+// resend of the game state (a keyframe), so that it can be played from any
+// keyframe without reading what came before. Keyframes are made every
+// RECORD_KEYFRAME_TURNS turns and whenever everything is resent anyway.
+// Each keyframe appends "<turn> <byte offset of its member>" to the
+// .idx file next to the recording.
+static const int RECORD_KEYFRAME_TURNS = 500;
+
+void TilesFramework::_open_recording()
+{
+    if (m_record_name.empty())
+        return;
+
+    m_record = gzopen(m_record_name.c_str(), "ab");
+    if (!m_record)
     {
-        if (len == -1)
-            die("Webtiles message format error! (%s)", format);
-        else
-            die("Webtiles message too long! (%d)", len);
+        fprintf(stderr, "Can't open webtiles recording %s: %s\n",
+                m_record_name.c_str(), strerror(errno));
     }
-    va_end(argp);
+}
 
-    m_msg_buf.append(buf);
+void TilesFramework::_close_recording()
+{
+    if (!m_record)
+        return;
 
-    finish_message();
+    gzclose(m_record);
+    m_record = nullptr;
+}
+
+void TilesFramework::_record_message()
+{
+    if (you.num_turns != m_record_turn)
+    {
+        // Anything up to a turn boundary survives a crash.
+        gzflush(m_record, Z_SYNC_FLUSH);
+        m_record_turn = you.num_turns;
+        gzprintf(m_record, "{\"msg\":\"rec_turn\",\"turn\":%d,"
+                           "\"time\":%lld}\n",
+                 m_record_turn, (long long) time(nullptr));
+    }
+    gzwrite(m_record, m_msg_buf.data(), m_msg_buf.size());
+}
+
+void TilesFramework::_record_keyframe()
+{
+    // Close the current member, so the next one starts at the end of the
+    // file.
+    _close_recording();
+    struct stat st;
+    const long long offset = stat(m_record_name.c_str(), &st) ? 0
+                                                              : st.st_size;
+    _open_recording();
+    if (!m_record)
+        return;
+
+    FILE *index = fopen_u((m_record_name + ".idx").c_str(), "a");
+    if (index)
+    {
+        fprintf(index, "%d %lld\n", you.num_turns, offset);
+        fclose(index);
+    }
+
+    m_record_turn = you.num_turns;
+    m_next_keyframe_turn = you.num_turns + RECORD_KEYFRAME_TURNS;
+    gzprintf(m_record, "{\"msg\":\"rec_keyframe\",\"turn\":%d,"
+                       "\"time\":%lld}\n",
+             m_record_turn, (long long) time(nullptr));
 }
 
 void TilesFramework::flush_messages()
 {
     if (_send_lock)
         return;
-    unwind_bool no_rentry(_send_lock, true);
 
+    _drain_all_dests();
+    if (m_record && you.num_turns >= m_next_keyframe_turn)
+        m_need_resync = true;
+    // Not while a message is half written.
+    if (m_need_resync && m_msg_buf.empty() && m_json_stack.empty())
+    {
+        m_need_resync = false;
+        if (m_record)
+            _record_keyframe();
+        _send_everything();
+    }
+
+    unwind_bool no_rentry(_send_lock, true);
     if (m_need_flush)
     {
         send_message("*{\"msg\":\"flush_messages\"}");
@@ -319,7 +722,7 @@ void TilesFramework::_await_connection()
     if (m_sock_name.empty())
         return;
 
-    while (m_dest_addrs.size() == 0)
+    while (m_dests.size() == 0)
         _receive_control_message();
 }
 
@@ -373,7 +776,7 @@ wint_t TilesFramework::_handle_control_message(sockaddr_un addr, string data)
         JsonWrapper primary = json_find_member(obj.node, "primary");
         primary.check(JSON_BOOL);
 
-        m_dest_addrs.push_back(addr);
+        m_dests.emplace_back(addr);
         m_controlled_from_web = primary->bool_;
     }
     else if (msgtype == "key")
@@ -386,9 +789,10 @@ wint_t TilesFramework::_handle_control_message(sockaddr_un addr, string data)
     }
     else if (msgtype == "spectator_joined")
     {
-        flush_messages();
-        _send_everything();
-        flush_messages();
+        // This can arrive mid-turn (e.g. through kbhit while resting), so
+        // leave the resend to the next flush, which also folds a burst of
+        // joins into one.
+        m_need_resync = true;
     }
     else if (msgtype == "menu_scroll")
     {
@@ -467,6 +871,8 @@ wint_t TilesFramework::_handle_control_message(sockaddr_un addr, string data)
     }
     else if (msgtype == "ui_state_sync")
         ui::recv_ui_state_change(obj.node);
+    else if (msgtype == "request_msg_stats")
+        _send_message_stats();
 
     return c;
 }
@@ -488,8 +894,18 @@ bool TilesFramework::await_input(wint_t& c, bool block)
 
             if (block)
             {
+                // Whatever made us wait for a key (a prompt, a --more--,
+                // an interrupted run) must not be shown a stale frame.
+                if (m_frame_deferred)
+                    redraw();
                 tiles.flush_messages();
-                result = select(maxfd + 1, &fds, nullptr, nullptr, nullptr);
+                // While a receiver is behind, wake up now and then to give
+                // it more of its backlog.
+                timeval retry;
+                retry.tv_sec = 0;
+                retry.tv_usec = 50 * 1000;
+                result = select(maxfd + 1, &fds, nullptr, nullptr,
+                                _has_pending_output() ? &retry : nullptr);
             }
             else
             {
@@ -502,7 +918,9 @@ bool TilesFramework::await_input(wint_t& c, bool block)
         }
         while (result == -1 && errno == EINTR);
 
-        if (result == 0)
+        if (result == 0 && block)
+            continue;
+        else if (result == 0)
             return false;
         else if (result > 0)
         {
@@ -545,6 +963,8 @@ void TilesFramework::dump()
 
 void TilesFramework::send_exit_reason(const string& type, const string& message)
 {
+    _send_message_stats();
+
     write_message("*");
     write_message("{\"msg\":\"exit_reason\",\"type\":\"");
     write_message_escaped(type);
@@ -804,7 +1224,7 @@ void TilesFramework::update_input_mode(mouse_mode mode, bool force)
 
 static bool _update_string(bool force, string& current,
                            const string& next,
-                           const string& name,
+                           TilesFramework::JsonString name,
                            bool update = true)
 {
     if (force || current != next)
@@ -819,7 +1239,7 @@ static bool _update_string(bool force, string& current,
 }
 
 template<class T> static bool _update_int(bool force, T& current, T next,
-                                          const string& name,
+                                          TilesFramework::JsonString name,
                                           bool update = true)
 {
     if (force || current != next)
@@ -1065,7 +1485,8 @@ void TilesFramework::_send_player(bool force_full)
     json_open_object("inv");
     for (unsigned int i = 0; i < ENDOFPACK; ++i)
     {
-        json_open_object(to_string(i));
+        char key[12];
+        json_open_object(_format_int(key, i));
         _send_item(c.inv[i], get_item_known_info(you.inv[i]), force_full);
         json_close_object(true);
     }
@@ -1075,7 +1496,8 @@ void TilesFramework::_send_player(bool force_full)
     for (unsigned int i = EQ_FIRST_EQUIP; i < NUM_EQUIP; ++i)
     {
         const int8_t equip = !you.melded[i] ? you.equip[i] : -1;
-        _update_int(force_full, c.equip[i], equip, to_string(i));
+        char key[12];
+        _update_int(force_full, c.equip[i], equip, _format_int(key, i));
     }
     json_close_object(true);
 
@@ -1265,8 +1687,10 @@ void TilesFramework::send_doll(const dolls_data &doll, bool submerged, bool ghos
             ymax = 18;
         }
 
-        tiles.json_write_comma();
-        tiles.write_message("[%u,%d]", (unsigned int) doll.parts[p], ymax);
+        tiles.json_open_array();
+        tiles.json_write_int((int) doll.parts[p]);
+        tiles.json_write_int(ymax);
+        tiles.json_close_array();
     }
     tiles.json_close_array();
 }
@@ -1284,8 +1708,8 @@ void TilesFramework::send_mcache(mcache_entry *entry, bool submerged, bool send)
             send_doll(*doll, submerged, trans);
         else
         {
-            tiles.json_write_comma();
-            tiles.write_message("\"doll\":[]");
+            tiles.json_open_array("doll");
+            tiles.json_close_array();
         }
     }
 
@@ -1295,9 +1719,11 @@ void TilesFramework::send_mcache(mcache_entry *entry, bool submerged, bool send)
     int draw_info_count = entry->info(&dinfo[0]);
     for (int i = 0; i < draw_info_count; i++)
     {
-        tiles.json_write_comma();
-        tiles.write_message("[%u,%d,%d]", (unsigned int) dinfo[i].idx,
-                            dinfo[i].ofs_x, dinfo[i].ofs_y);
+        tiles.json_open_array();
+        tiles.json_write_int((int) dinfo[i].idx);
+        tiles.json_write_int(dinfo[i].ofs_x);
+        tiles.json_write_int(dinfo[i].ofs_y);
+        tiles.json_close_array();
     }
 
     tiles.json_close_array();
@@ -1338,11 +1764,22 @@ void TilesFramework::write_tileidx(tileidx_t t)
     const int lo = t & 0xFFFFFFFF;
     const int hi = t >> 32;
     if (hi == 0)
-        tiles.write_message("%d", lo);
+        _append_int(m_msg_buf, lo);
     else
-        tiles.write_message("[%d,%d]", lo, hi);
+    {
+        m_msg_buf.push_back('[');
+        _append_int(m_msg_buf, lo);
+        m_msg_buf.push_back(',');
+        _append_int(m_msg_buf, hi);
+        m_msg_buf.push_back(']');
+    }
 }
 
+// Writes the changes to one cell as a JSON object, which the client merges
+// into its map knowledge as is. The server wraps every message in a JSON
+// envelope and deflates each websocket stream, so the repeated short keys
+// here cost little on the wire; a binary cell format would have to be
+// base64'd into that envelope and decoded again by the client.
 void TilesFramework::_send_cell(const coord_def &gc,
                                 const screen_cell_t &current_sc, const screen_cell_t &next_sc,
                                 const map_cell &current_mc, const map_cell &next_mc,
@@ -1478,8 +1915,12 @@ void TilesFramework::_send_cell(const coord_def &gc,
                     send_mcache(entry, in_water);
                 else
                 {
-                    json_write_comma();
-                    write_message("\"doll\":[[%d,%d]]", TILEP_MONS_UNKNOWN, TILE_Y);
+                    json_open_array("doll");
+                    json_open_array();
+                    json_write_int(TILEP_MONS_UNKNOWN);
+                    json_write_int(TILE_Y);
+                    json_close_array();
+                    json_close_array();
                     json_write_null("mcache");
                 }
             }
@@ -1530,8 +1971,12 @@ void TilesFramework::_send_cell(const coord_def &gc,
         {
             if (fg_changed)
             {
-                json_write_comma();
-                write_message("\"doll\":[[%u,%d]]", (unsigned int) fg_idx, TILE_Y);
+                json_open_array("doll");
+                json_open_array();
+                json_write_int((int) fg_idx);
+                json_write_int(TILE_Y);
+                json_close_array();
+                json_close_array();
                 json_write_null("mcache");
             }
         }
@@ -1654,55 +2099,74 @@ void TilesFramework::_send_map(bool force_full)
     coord_def last_gc(0, 0);
     bool send_gc = true;
 
-    json_open_array("cells");
-    for (int y = 0; y < GYM; y++)
-        for (int x = 0; x < GXM; x++)
-        {
-            coord_def gc(x, y);
+    // Cells are sent in row-major order, so that runs of adjacent cells can
+    // leave out their coordinates. Anything marked dirty while we are
+    // sending goes on a fresh list, for next time.
+    vector<coord_def> cells;
+    cells.swap(m_dirty_list);
+    if (force_full)
+    {
+        cells.clear();
+        cells.reserve(GXM * GYM);
+        for (int y = 0; y < GYM; y++)
+            for (int x = 0; x < GXM; x++)
+                cells.emplace_back(x, y);
+    }
+    else
+    {
+        sort(cells.begin(), cells.end(),
+             [](const coord_def &a, const coord_def &b)
+             {
+                 return a.y < b.y || (a.y == b.y && a.x < b.x);
+             });
+    }
 
-            if (!is_dirty(gc) && !force_full)
-                continue;
+    json_open_array("cells");
+    for (const coord_def &gc : cells)
+    {
+        if (!is_dirty(gc) && !force_full)
+            continue;
 
-            if (cell_needs_redraw(gc))
-            {
-                screen_cell_t *cell = &m_next_view(gc);
+        if (cell_needs_redraw(gc))
+        {
+            screen_cell_t *cell = &m_next_view(gc);
 
-                draw_cell(cell, gc, false, m_current_flash_colour);
-                pack_cell_overlays(gc, m_next_view);
-            }
+            draw_cell(cell, gc, false, m_current_flash_colour);
+            pack_cell_overlays(gc, m_next_view);
+        }
 
-            mark_clean(gc);
+        mark_clean(gc);
 
-            if (m_origin.equals(-1, -1))
-                m_origin = gc;
+        if (m_origin.equals(-1, -1))
+            m_origin = gc;
 
-            json_open_object();
-            if (send_gc
-                || last_gc.x + 1 != gc.x
-                || last_gc.y != gc.y)
-            {
-                json_write_int("x", x - m_origin.x);
-                json_write_int("y", y - m_origin.y);
-                json_treat_as_empty();
-            }
+        json_open_object();
+        if (send_gc
+            || last_gc.x + 1 != gc.x
+            || last_gc.y != gc.y)
+        {
+            json_write_int("x", gc.x - m_origin.x);
+            json_write_int("y", gc.y - m_origin.y);
+            json_treat_as_empty();
+        }
 
-            const screen_cell_t& sc = force_full ? default_cell
-                : m_current_view(gc);
-            const map_cell& mc = force_full ? default_map_cell
-                : m_current_map_knowledge(gc);
-            _send_cell(gc,
-                       sc,
-                       m_next_view(gc),
-                       mc, env.map_knowledge(gc),
-                       new_monster_locs, force_full);
-
-            if (!json_is_empty())
-            {
-                send_gc = false;
-                last_gc = gc;
-            }
-            json_close_object(true);
+        const screen_cell_t& sc = force_full ? default_cell
+            : m_current_view(gc);
+        const map_cell& mc = force_full ? default_map_cell
+            : m_current_map_knowledge(gc);
+        _send_cell(gc,
+                   sc,
+                   m_next_view(gc),
+                   mc, env.map_knowledge(gc),
+                   new_monster_locs, force_full);
+
+        if (!json_is_empty())
+        {
+            send_gc = false;
+            last_gc = gc;
         }
+        json_close_object(true);
+    }
     json_close_array(true);
 
     json_close_object(true);
@@ -1973,6 +2437,19 @@ void TilesFramework::cgotoxy(int x, int y, GotoRegion region)
     m_cursor_region = region;
 }
 
+bool TilesFramework::_should_defer_frame() const
+{
+    if (Options.tile_web_max_fps <= 0)
+        return false;
+    if (!you.running && !you_are_delayed())
+        return false;
+    // Layout and UI changes are rare and the client needs them in order.
+    if (m_layout_reset || m_last_ui_state != m_ui_state)
+        return false;
+    const unsigned int ticks = get_milliseconds() - m_last_tick_redraw;
+    return ticks < 1000u / Options.tile_web_max_fps;
+}
+
 void TilesFramework::redraw()
 {
     if (!has_receivers())
@@ -1985,6 +2462,12 @@ void TilesFramework::redraw()
         return;
     }
 
+    // While running or resting, views can come faster than anyone can
+    // watch them; merge them into the next frame that is let through.
+    m_frame_deferred = _should_defer_frame();
+    if (m_frame_deferred)
+        return;
+
     if (m_layout_reset)
     {
         _send_layout();
@@ -2185,7 +2668,12 @@ void TilesFramework::mark_for_redraw(const coord_def& gc)
 
 void TilesFramework::mark_dirty(const coord_def& gc)
 {
-    m_dirty_cells[gc.y * GXM + gc.x] = true;
+    const int i = gc.y * GXM + gc.x;
+    if (!m_dirty_cells[i])
+    {
+        m_dirty_cells[i] = true;
+        m_dirty_list.push_back(gc);
+    }
 }
 
 void TilesFramework::mark_clean(const coord_def& gc)
@@ -2204,36 +2692,46 @@ bool TilesFramework::cell_needs_redraw(const coord_def& gc)
     return m_cells_needing_redraw[gc.y * GXM + gc.x];
 }
 
-void TilesFramework::write_message_escaped(const string& s)
+void TilesFramework::write_message_escaped(JsonString s)
 {
-    for (unsigned char c : s)
+    static const char hex[] = "0123456789abcdef";
+
+    // Copy runs of characters that need no escaping in one go.
+    const char *run = s.str;
+    const char *end = s.str + s.len;
+    for (const char *p = run; p != end; ++p)
     {
+        const unsigned char c = *p;
+        if (c >= 0x20 && c != '"' && c != '\\')
+            continue;
+
+        m_msg_buf.append(run, p - run);
+        run = p + 1;
         if (c == '"')
-            m_msg_buf.append("\\\"");
+            m_msg_buf.append("\\\"", 2);
         else if (c == '\\')
-            m_msg_buf.append("\\\\");
-        else if (c < 0x20)
+            m_msg_buf.append("\\\\", 2);
+        else
         {
-            char buf[7];
-            snprintf(buf, sizeof(buf), "\\u%04x", c);
-            m_msg_buf.append(buf);
+            const char esc[] = { '\\', 'u', '0', '0', hex[c >> 4], hex[c & 0xF] };
+            m_msg_buf.append(esc, sizeof(esc));
         }
-        else
-            m_msg_buf.push_back(c);
     }
+    m_msg_buf.append(run, end - run);
 }
 
-void TilesFramework::json_open(const string& name, char opener, char type)
+void TilesFramework::json_open(JsonString name, char opener, char type)
 {
+    _start_message();
     m_json_stack.resize(m_json_stack.size() + 1);
     JsonFrame& fr = m_json_stack.back();
     fr.start = m_msg_buf.size();
 
     json_write_comma();
-    if (!name.empty())
+    if (name.len)
         json_write_name(name);
 
-    m_msg_buf.append(1, opener);
+    m_msg_buf.push_back(opener);
 
     fr.prefix_end = m_msg_buf.size();
     fr.type = type;
@@ -2270,12 +2768,12 @@ void TilesFramework::json_close(bool erase_if_empty, char type)
     if (erase_if_empty && json_is_empty())
         m_msg_buf.resize(m_json_stack.back().start);
     else
-        m_msg_buf.append(1, type);
+        m_msg_buf.push_back(type);
 
     m_json_stack.pop_back();
 }
 
-void TilesFramework::json_open_object(const string& name)
+void TilesFramework::json_open_object(JsonString name)
 {
     json_open(name, '{', '}');
 }
@@ -2285,7 +2783,7 @@ void TilesFramework::json_close_object(bool erase_if_empty)
     json_close(erase_if_empty, '}');
 }
 
-void TilesFramework::json_open_array(const string& name)
+void TilesFramework::json_open_array(JsonString name)
 {
     json_open(name, '[', ']');
 }
@@ -2300,28 +2798,28 @@ void TilesFramework::json_write_comma()
     if (m_msg_buf.empty()) return;
     char last = m_msg_buf[m_msg_buf.size() - 1];
     if (last == '{' || last == '[' || last == ',' || last == ':') return;
-    write_message(",");
+    m_msg_buf.push_back(',');
 }
 
-void TilesFramework::json_write_name(const string& name)
+void TilesFramework::json_write_name(JsonString name)
 {
     json_write_comma();
 
-    write_message("\"");
+    m_msg_buf.push_back('"');
     write_message_escaped(name);
-    write_message("\":");
+    m_msg_buf.append("\":", 2);
 }
 
 void TilesFramework::json_write_int(int value)
 {
     json_write_comma();
 
-    write_message("%d", value);
+    _append_int(m_msg_buf, value);
 }
 
-void TilesFramework::json_write_int(const string& name, int value)
+void TilesFramework::json_write_int(JsonString name, int value)
 {
-    if (!name.empty())
+    if (name.len)
         json_write_name(name);
 
     json_write_int(value);
@@ -2332,14 +2830,14 @@ void TilesFramework::json_write_bool(bool value)
     json_write_comma();
 
     if (value)
-        write_message("true");
+        m_msg_buf.append("true", 4);
     else
-        write_message("false");
+        m_msg_buf.append("false", 5);
 }
 
-void TilesFramework::json_write_bool(const string& name, bool value)
+void TilesFramework::json_write_bool(JsonString name, bool value)
 {
-    if (!name.empty())
+    if (name.len)
         json_write_name(name);
 
     json_write_bool(value);
@@ -2349,29 +2847,29 @@ void TilesFramework::json_write_null()
 {
     json_write_comma();
 
-    write_message("null");
+    m_msg_buf.append("null", 4);
 }
 
-void TilesFramework::json_write_null(const string& name)
+void TilesFramework::json_write_null(JsonString name)
 {
-    if (!name.empty())
+    if (name.len)
         json_write_name(name);
 
     json_write_null();
 }
 
-void TilesFramework::json_write_string(const string& value)
+void TilesFramework::json_write_string(JsonString value)
 {
     json_write_comma();
 
-    write_message("\"");
+    m_msg_buf.push_back('"');
     write_message_escaped(value);
-    write_message("\"");
+    m_msg_buf.push_back('"');
 }
 
-void TilesFramework::json_write_string(const string& name, const string& value)
+void TilesFramework::json_write_string(JsonString name, JsonString value)
 {
-    if (!name.empty())
+    if (name.len)
         json_write_name(name);
 
     json_write_string(value);
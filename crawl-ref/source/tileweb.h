@@ -8,11 +8,16 @@
 #ifdef USE_TILE_WEB
 
 #include <bitset>
+#include <chrono>
+#include <deque>
 #include <map>
+#include <memory>
 #include <vector>
 
 #include <sys/un.h>
 
+#include <zlib.h>
+
 #include "cursor-type.h"
 #include "equipment-type.h"
 #include "map-cell.h"
@@ -115,6 +120,7 @@ public:
     void set_need_redraw(unsigned int min_tick_delay = 0);
     bool need_redraw() const;
     void redraw();
+    bool frame_deferred() const { return m_frame_deferred; }
 
     void place_cursor(cursor_type type, const coord_def &gc);
     void clear_text_tags(text_tag_type type);
@@ -153,7 +159,7 @@ public:
     void send_message(PRINTF(1, ));
     void flush_messages();
 
-    bool has_receivers() { return !m_dest_addrs.empty(); }
+    bool has_receivers() { return !m_dests.empty(); }
     bool is_controlled_from_web() { return m_controlled_from_web; }
 
     /* Webtiles can receive input both via stdin, and on the
@@ -175,22 +181,33 @@ public:
 
     void check_for_control_messages();
 
+    // A borrowed string for the JSON writers below, so that field names and
+    // values given as literals are not copied into a temporary string.
+    struct JsonString
+    {
+        JsonString(const char *s) : str(s), len(strlen(s)) {}
+        JsonString(const string &s) : str(s.data()), len(s.size()) {}
+
+        const char *str;
+        size_t len;
+    };
+
     // Helper functions for writing JSON
-    void write_message_escaped(const string& s);
-    void json_open_object(const string& name = "");
+    void write_message_escaped(JsonString s);
+    void json_open_object(JsonString name = "");
     void json_close_object(bool erase_if_empty = false);
-    void json_open_array(const string& name = "");
+    void json_open_array(JsonString name = "");
     void json_close_array(bool erase_if_empty = false);
     void json_write_comma();
-    void json_write_name(const string& name);
+    void json_write_name(JsonString name);
     void json_write_int(int value);
-    void json_write_int(const string& name, int value);
+    void json_write_int(JsonString name, int value);
     void json_write_bool(bool value);
-    void json_write_bool(const string& name, bool value);
+    void json_write_bool(JsonString name, bool value);
     void json_write_null();
-    void json_write_null(const string& name);
-    void json_write_string(const string& value);
-    void json_write_string(const string& name, const string& value);
+    void json_write_null(JsonString name);
+    void json_write_string(JsonString value);
+    void json_write_string(JsonString name, JsonString value);
     /* Causes the current object/array to be erased if it is closed
        with erase_if_empty without writing any other content after
        this call */
@@ -200,6 +217,9 @@ public:
 
     string m_sock_name;
     bool m_await_connection;
+    // If set, everything sent to the client is also appended to this
+    // gzipped file; see _record_keyframe.
+    string m_record_name;
 
     void set_text_cursor(bool enabled);
     void set_ui_state(WebtilesUIState state);
@@ -220,13 +240,94 @@ protected:
     int m_sock;
     int m_max_msg_size;
     string m_msg_buf;
-    vector<sockaddr_un> m_dest_addrs;
+
+    // A receiver of our messages, and whatever it has not taken yet because
+    // its socket buffer was full. Messages are shared between the queues of
+    // all receivers that fell behind on them.
+    struct MessageDest
+    {
+        MessageDest(const sockaddr_un &_addr)
+            : addr(_addr), pending_offset(0), pending_bytes(0), resync(false)
+        {}
+
+        sockaddr_un addr;
+        deque<shared_ptr<const string>> pending;
+        size_t pending_offset; // bytes of pending.front() already sent
+        size_t pending_bytes;  // bytes in pending not yet sent
+        // Too far behind: drop its messages, then resend everything once it
+        // has caught up with what is left.
+        bool resync;
+    };
+    vector<MessageDest> m_dests;
+    // Call _send_everything at the next flush_messages: a spectator joined,
+    // or a lagging receiver caught up.
+    bool m_need_resync;
+    // Bytes dropped from the queues of lagging receivers, and how many
+    // times that has happened.
+    uint64_t m_coalesced_bytes;
+    int m_coalesce_count;
+
+    // Messages, bytes and encoding time per "msg" type, for the whole
+    // session, for the turn in progress and for the last finished turn
+    // (m_last_stats_turn). Reported to the server on request and when the
+    // game ends.
+    struct MessageStats
+    {
+        MessageStats(const char *_type, size_t len)
+            : type(_type, len), count(0), bytes(0), usecs(0)
+        {}
+
+        string type;
+        unsigned int count;
+        uint64_t bytes;
+        uint64_t usecs;
+    };
+    vector<MessageStats> m_session_stats;
+    vector<MessageStats> m_turn_stats;
+    vector<MessageStats> m_last_turn_stats;
+    int m_stats_turn;
+    int m_last_stats_turn;
+    // When the message now in m_msg_buf was started.
+    std::chrono::steady_clock::time_point m_msg_start;
+
+    void _start_message();
+    void _account_message();
+    static void _add_message_stats(vector<MessageStats> &stats,
+                                   const char *type, size_t len,
+                                   size_t bytes, uint64_t usecs);
+    void _write_message_stats(const char *name,
+                              const vector<MessageStats> &stats);
+    void _send_message_stats();
+
+    // The recording, while open.
+    gzFile m_record;
+    int m_record_turn;
+    int m_next_keyframe_turn;
+
+    void _open_recording();
+    void _close_recording();
+    void _record_message();
+    void _record_keyframe();
 
     bool m_controlled_from_web;
     bool m_need_flush;
 
     bool _send_lock; // not thread safe
 
+    enum send_result
+    {
+        SEND_DONE,
+        SEND_BLOCKED,
+        SEND_CLOSED,
+    };
+    send_result _send_datagrams(const sockaddr_un &addr, const string &data,
+                                size_t &sent);
+    send_result _drain_dest(MessageDest &dest);
+    void _drain_all_dests();
+    void _drain_before_exit();
+    void _coalesce_backlog(MessageDest &dest);
+    bool _has_pending_output() const;
+
     void _await_connection();
     wint_t _handle_control_message(sockaddr_un addr, string data);
     wint_t _receive_control_message();
@@ -239,7 +340,7 @@ protected:
     };
     vector<JsonFrame> m_json_stack;
 
-    void json_open(const string& name, char opener, char type);
+    void json_open(JsonString name, char opener, char type);
     void json_close(bool erase_if_empty, char type);
 
     struct UIStackFrame
@@ -259,6 +360,11 @@ protected:
     unsigned int m_last_tick_redraw;
     bool m_need_redraw;
     bool m_layout_reset;
+    // Set when redraw() held back a frame because the player is running,
+    // resting or in a multi-turn delay and the last frame went out less
+    // than 1000 / tile_web_max_fps ms ago. The dirty cells and player
+    // state keep accumulating, so the next frame sent carries the union.
+    bool m_frame_deferred;
 
     coord_def m_origin;
 
@@ -274,6 +380,9 @@ protected:
     coord_def m_next_view_br;
 
     bitset<GXM * GYM> m_dirty_cells;
+    // The cells set in m_dirty_cells, so that _send_map need not scan the
+    // whole level for them.
+    vector<coord_def> m_dirty_list;
     bitset<GXM * GYM> m_cells_needing_redraw;
     void mark_dirty(const coord_def& gc);
     void mark_clean(const coord_def& gc);
@@ -311,6 +420,7 @@ protected:
     void _send_layout();
 
     void _send_everything();
+    bool _should_defer_frame() const;
 
     bool m_mcache_ref_done;
     void _mcache_ref(bool inc);
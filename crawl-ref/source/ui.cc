@@ -3492,7 +3492,7 @@ void progress_popup::force_redraw()
 {
 #ifdef USE_TILE_WEB
     tiles.json_open_object();
-    tiles.json_write_string("status", status_text->get_text());
+    tiles.json_write_string("status", status_text->get_text().tostring());
     tiles.json_write_string("bar_text",
         progress_bar->get_text().to_colour_string());
     tiles.ui_state_change("progress-bar", 0);
@@ -0,0 +1,75 @@
+#!/usr/bin/env python3
+
+"""
+Print the webtiles messages of a recording made with -webtiles-record,
+starting from the last keyframe at or before a given turn.
+
+The output is one JSON message per line, as the game sent them, so it can
+be fed to a client to show the game from that turn on. The recording's
+own markers (rec_keyframe, rec_turn) are left out.
+"""
+
+import argparse
+import json
+import sys
+import zlib
+
+
+def read_index(filename):
+    """Return (turn, offset) pairs from the recording's .idx file."""
+    keyframes = []
+    with open(filename + ".idx") as f:
+        for line in f:
+            turn, offset = line.split()
+            keyframes.append((int(turn), int(offset)))
+    return keyframes
+
+
+def read_lines(filename, offset):
+    """Yield decompressed lines from offset on, across gzip members.
+
+    A recording cut short (the game crashed) stops at the last complete
+    line rather than failing."""
+    with open(filename, "rb") as f:
+        f.seek(offset)
+        d = zlib.decompressobj(16 + zlib.MAX_WBITS)
+        pending = b""
+        while True:
+            data = d.unused_data or f.read(65536)
+            if not data:
+                break
+            if d.eof:
+                d = zlib.decompressobj(16 + zlib.MAX_WBITS)
+            pending += d.decompress(data)
+            lines = pending.split(b"\n")
+            pending = lines.pop()
+            for line in lines:
+                yield line.decode("utf-8")
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.strip())
+    parser.add_argument("recording")
+    parser.add_argument("turn", type=int, nargs="?", default=0,
+                        help="turn to start watching from")
+    parser.add_argument("--until", type=int,
+                        help="stop at the first message after this turn")
+    args = parser.parse_args()
+
+    offset = 0
+    for turn, keyframe_offset in read_index(args.recording):
+        if turn > args.turn:
+            break
+        offset = keyframe_offset
+
+    for line in read_lines(args.recording, offset):
+        if line.startswith('{"msg":"rec_'):
+            marker = json.loads(line)
+            if args.until is not None and marker["turn"] > args.until:
+                break
+            continue
+        sys.stdout.write(line + "\n")
+
+
+if __name__ == "__main__":
+    main()
@@ -27,9 +27,39 @@ define(["jquery", "comm"], function ($, comm) {
         span.html(content);
     }
 
+    // Line y takes the contents of line y + shift; lines shifted in from
+    // outside the area are empty. Lines are moved, not re-rendered.
+    function shift_text_area(area, shift, rows)
+    {
+        var lines = area.children("span");
+        var n = Math.min(Math.abs(shift), lines.length);
+        if (shift > 0)
+        {
+            for (var i = 0; i < n; ++i)
+            {
+                var line = lines.eq(i);
+                var br = line.next("br");
+                area.append(line.empty(), br);
+            }
+        }
+        else
+        {
+            var keep = Math.max(rows + shift, 0);
+            for (var i = lines.length - 1; i >= keep; --i)
+            {
+                lines.eq(i).next("br").remove();
+                lines.eq(i).remove();
+            }
+            for (var i = 0; i < -shift && i < rows; ++i)
+                area.prepend(line_span.clone(), "<br>");
+        }
+    }
+
     function handle_text_update(data)
     {
         var area = get_container(data.id)
+        if (data.shift)
+            shift_text_area(area, data.shift, data.rows);
         if (data.clear)
         {
             var lines = area.children("span");
@@ -763,6 +763,12 @@ class CrawlProcessHandler(CrawlProcessHandlerBase):
         if ttyrec_path:
             self.ttyrec_filename = os.path.join(ttyrec_path, self.lock_basename)
 
+        record_path = self.config_path("webtiles_record_path")
+        if record_path:
+            call += ["-webtiles-record",
+                     os.path.join(record_path,
+                                  self.formatted_time + ".wtrec.gz")]
+
         processes[os.path.abspath(self.socketpath)] = self
 
         if config.dgl_mode:
@@ -978,6 +984,12 @@ class CrawlProcessHandler(CrawlProcessHandlerBase):
                         self.send_to_all("dump", url = url)
                     else:
                         self.exit_dump_url = url
+            elif msgobj["msg"] == "msg_stats":
+                # Per message type bandwidth and encoding time, sent when
+                # the game ends or on a request_msg_stats control message.
+                del msgobj["msg"]
+                self.logger.info("Webtiles message stats: %s",
+                                 json_encode(msgobj))
             elif msgobj["msg"] == "exit_reason":
                 self.exit_reason = msgobj["type"]
                 if "message" in msgobj:
@@ -34,6 +34,7 @@
 #include "worley.h"
 
 #include <cfloat>
+#include <functional>
 #include <math.h>
 #include <stdint.h>
 #include <stdio.h>
@@ -63,15 +64,39 @@ namespace worley
        is 1.0. This makes an easy natural "scale" size of the cellular features. */
 #define DENSITY_ADJUSTMENT  0.398150
 
+    /* The feature points of one cube, as generated from its seed. At most
+       five, since that is the largest entry of Poisson_count. */
+    struct cube_points
+    {
+        int32_t count;
+        uint32_t id[5];
+        double f[5][3];
+    };
+
+    static void CubePoints(int32_t xi, int32_t yi, int32_t zi, cube_points &pts);
+
     /* the function to merge-sort a "cube" of samples into the current best-found
        list of values. */
-    static void AddSamples(int32_t xi, int32_t yi, int32_t zi, int32_t max_order,
+    static void MergeSamples(int32_t xi, int32_t yi, int32_t zi,
+            const cube_points &pts, int32_t max_order,
             double at[3], double *F,
             double (*delta)[3], uint32_t *ID);
 
-    /* The main function! */
+    static void AddSamples(int32_t xi, int32_t yi, int32_t zi, int32_t max_order,
+            double at[3], double *F,
+            double (*delta)[3], uint32_t *ID)
+    {
+        cube_points pts;
+        CubePoints(xi, yi, zi, pts);
+        MergeSamples(xi, yi, zi, pts, max_order, at, F, delta, ID);
+    }
+
+    /* The main function! <add_samples> is called with the same arguments
+       as AddSamples(), and must behave identically; noise_row() uses this
+       to share cube generation between neighbouring samples. */
+    template<typename Adder>
     static void _worley(double at[3], int32_t max_order,
-            double *F, double (*delta)[3], uint32_t *ID)
+            double *F, double (*delta)[3], uint32_t *ID, Adder AddSamples)
     {
         double x2,y2,z2, mx2, my2, mz2;
         double new_at[3];
@@ -194,13 +219,10 @@ namespace worley
         return;
     }
 
-    static void AddSamples(int32_t xi, int32_t yi, int32_t zi, int32_t max_order,
-            double at[3], double *F,
-            double (*delta)[3], uint32_t *ID)
+    static void CubePoints(int32_t xi, int32_t yi, int32_t zi, cube_points &pts)
     {
-        double dx, dy, dz, fx, fy, fz, d2;
-        int32_t count, i, j, index;
-        uint32_t seed, this_id;
+        int32_t j;
+        uint32_t seed;
 
         /* Each cube has a random number seed based on the cube's ID number.
            The seed might be better if it were a nonlinear hash like Perlin uses
@@ -209,22 +231,40 @@ namespace worley
         seed=702395077*xi + 915488749*yi + 2120969693*zi;
 
         /* How many feature points are in this cube? */
-        count=Poisson_count[(seed>>24)%256]; /* 256 element lookup table. Use MSB */
+        pts.count=Poisson_count[(seed>>24)%256]; /* 256 element lookup table. Use MSB */
 
         seed=1402024253*seed+586950981; /* churn the seed with good Knuth LCG */
 
-        for (j=0; j<count; j++) /* test and insert each point into our solution */
+        for (j=0; j<pts.count; j++)
         {
-            this_id=seed;
+            pts.id[j]=seed;
             seed=1402024253*seed+586950981; /* churn */
 
             /* compute the 0..1 feature point location's XYZ */
-            fx=(seed+0.5)*(1.0/4294967296.0);
+            pts.f[j][0]=(seed+0.5)*(1.0/4294967296.0);
             seed=1402024253*seed+586950981; /* churn */
-            fy=(seed+0.5)*(1.0/4294967296.0);
+            pts.f[j][1]=(seed+0.5)*(1.0/4294967296.0);
             seed=1402024253*seed+586950981; /* churn */
-            fz=(seed+0.5)*(1.0/4294967296.0);
+            pts.f[j][2]=(seed+0.5)*(1.0/4294967296.0);
             seed=1402024253*seed+586950981; /* churn */
+        }
+    }
+
+    static void MergeSamples(int32_t xi, int32_t yi, int32_t zi,
+            const cube_points &pts, int32_t max_order,
+            double at[3], double *F,
+            double (*delta)[3], uint32_t *ID)
+    {
+        double dx, dy, dz, fx, fy, fz, d2;
+        int32_t i, j, index;
+        uint32_t this_id;
+
+        for (j=0; j<pts.count; j++) /* test and insert each point into our solution */
+        {
+            this_id=pts.id[j];
+            fx=pts.f[j][0];
+            fy=pts.f[j][1];
+            fz=pts.f[j][2];
 
             /* delta from feature point to sample location */
             dx=xi+fx-at[0];
@@ -281,15 +321,9 @@ cases.]
         return;
     }
 
-    noise_datum noise(double x, double y, double z)
+    static noise_datum _datum(const double F[2], const double delta[2][3],
+                              const uint32_t id[2])
     {
-        double point[3] = {x,y,z};
-        double F[2];
-        double delta[2][3];
-        uint32_t id[2];
-
-        _worley(point, 2, F, delta, id);
-
         noise_datum datum;
         datum.distance[0] = F[0];
         datum.distance[1] = F[1];
@@ -300,4 +334,92 @@ cases.]
                 datum.pos[i][j] = delta[i][j];
         return datum;
     }
+
+    noise_datum noise(double x, double y, double z)
+    {
+        double point[3] = {x,y,z};
+        double F[2];
+        double delta[2][3];
+        uint32_t id[2];
+
+        _worley(point, 2, F, delta, id, AddSamples);
+        return _datum(F, delta, id);
+    }
+
+    /* Every sample in a row shares its y and z cube coordinates, so the
+       3x3 cubes around them in y and z only vary with the x cube. Keep the
+       generated feature points for the last few x cubes; samples are
+       usually close enough together that each cube is generated once per
+       row rather than once per sample. */
+    namespace
+    {
+        const int32_t ROW_CACHE_COLUMNS = 8;
+
+        struct cube_column
+        {
+            int32_t xi;
+            bool valid;
+            bool filled[3][3];
+            cube_points pts[3][3];
+        };
+
+        class row_sampler
+        {
+        public:
+            row_sampler(int32_t yi, int32_t zi) : base_yi(yi), base_zi(zi)
+            {
+                for (int32_t i = 0; i < ROW_CACHE_COLUMNS; ++i)
+                    columns[i].valid = false;
+            }
+
+            void operator()(int32_t xi, int32_t yi, int32_t zi,
+                            int32_t max_order, double at[3], double *F,
+                            double (*delta)[3], uint32_t *ID)
+            {
+                cube_column &col = columns[xi & (ROW_CACHE_COLUMNS - 1)];
+                if (!col.valid || col.xi != xi)
+                {
+                    col.xi = xi;
+                    col.valid = true;
+                    for (int32_t j = 0; j < 3; ++j)
+                        for (int32_t k = 0; k < 3; ++k)
+                            col.filled[j][k] = false;
+                }
+
+                const int32_t j = yi - base_yi + 1, k = zi - base_zi + 1;
+                cube_points &pts = col.pts[j][k];
+                if (!col.filled[j][k])
+                {
+                    CubePoints(xi, yi, zi, pts);
+                    col.filled[j][k] = true;
+                }
+                MergeSamples(xi, yi, zi, pts, max_order, at, F, delta, ID);
+            }
+
+        private:
+            const int32_t base_yi, base_zi;
+            cube_column columns[ROW_CACHE_COLUMNS];
+        };
+    }
+
+    void noise_row(const double *x, int count, double y, double z,
+                   noise_datum *out)
+    {
+        /* LFLOOR() casts its argument unparenthesised, so scale first. */
+        const double ya=DENSITY_ADJUSTMENT*y, za=DENSITY_ADJUSTMENT*z;
+        const int32_t yi = LFLOOR(ya);
+        const int32_t zi = LFLOOR(za);
+        row_sampler sampler(yi, zi);
+
+        for (int i = 0; i < count; ++i)
+        {
+            double point[3] = {x[i],y,z};
+            double F[2];
+            double delta[2][3];
+            uint32_t id[2];
+
+            _worley(point, 2, F, delta, id, std::ref(sampler));
+            out[i] = _datum(F, delta, id);
+        }
+    }
 }
@@ -71,4 +71,8 @@ struct noise_datum
 };
 
 noise_datum noise(double x, double y, double z);
+// noise() at (x[i], y, z) for each of the count samples in a row, written
+// to out[i]. The results are identical to calling noise() on each point.
+void noise_row(const double *x, int count, double y, double z,
+               noise_datum *out);
 }